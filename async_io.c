@@ -0,0 +1,596 @@
+/*
+* async_io.c
+ *
+ * Implements asynchronous write-back.
+ *
+ * A flush is a job: an ordered list of operations (data writes, header
+ * write, fsync). Only one job runs at a time so headers land in order.
+ * - io_uring: operations are submitted as one IOSQE_IO_LINK chain. If the
+ *   chain does not fit in the ring it is split into batches, and the next
+ *   batch is submitted once the previous one has fully completed.
+ * - Thread pool: data writes run in parallel; the header and fsync are
+ *   barriers that start only when nothing else of the job is in flight.
+ */
+
+#define _GNU_SOURCE // O_DIRECT
+#include "async_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum async_opkind {
+    async_op_data,    // Record range, may run alongside other data writes
+    async_op_header,  // Header commit, after all data writes
+    async_op_fsync    // After the header
+};
+
+typedef struct async_op {
+    enum async_opkind kind;
+    int direct;       // Use the O_DIRECT descriptor
+    uint64_t offset;
+    void *buf;
+    size_t len;
+} async_op;
+
+typedef struct async_job {
+    async_op *ops;
+    size_t nops;
+    size_t next_op;   // Next op to start
+    size_t inflight;  // Started, not completed
+    int error;        // First failure, negative errno
+    int cancels;      // Failed and cancelled the jobs behind it
+    async_callback cb;
+    void *arg;
+    struct async_job *next;
+} async_job;
+
+typedef struct async_uring {
+    int fd;
+    unsigned entries;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size;
+    struct io_uring_sqe *sqes;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+} async_uring;
+
+struct async_io {
+    int fd;           // Buffered descriptor (caller's)
+    int direct_fd;    // O_DIRECT descriptor or -1
+    int use_uring;
+    async_uring ring;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;     // Work for pool threads
+    pthread_cond_t done_cv;  // A job finished
+    pthread_t threads[ASYNC_POOL_THREADS];
+    int nthreads;
+    int stop;
+
+    async_job *active;       // Job being written
+    async_job *queue_head;   // Waiting jobs, FIFO
+    async_job *queue_tail;
+    async_job *done_head;    // Finished jobs awaiting callbacks, FIFO
+    async_job *done_tail;
+    size_t pending;          // Jobs not yet handed to a callback
+    int failed;              // A job failed: cancel new ones until its callback has run
+};
+
+/* ---------- jobs ---------- */
+
+static void job_free(async_job *job)
+{
+    if (!job) return;
+    for (size_t i = 0; i < job->nops; i++)
+        free(job->ops[i].buf);
+    free(job->ops);
+    free(job);
+}
+
+static int job_add(async_job *job, size_t *cap, enum async_opkind kind, int direct,
+                   uint64_t offset, const void *data, size_t len)
+{
+    if (job->nops == *cap)
+    {
+        size_t new_cap = *cap ? *cap * 2 : 8;
+        async_op *temp = realloc(job->ops, new_cap * sizeof(async_op));
+        if (!temp) return -1;
+        job->ops = temp;
+        *cap = new_cap;
+    }
+
+    async_op *op = &job->ops[job->nops];
+    op->kind = kind;
+    op->direct = direct;
+    op->offset = offset;
+    op->len = len;
+    op->buf = NULL;
+
+    if (len > 0)
+    {
+        op->buf = direct ? aligned_alloc(ASYNC_ALIGN, len) : malloc(len);
+        if (!op->buf) return -1;
+        memcpy(op->buf, data, len);
+    }
+    job->nops++;
+    return 0;
+}
+
+/* Split a write into an O_DIRECT aligned middle and buffered edges */
+static int job_add_write(async_job *job, size_t *cap, int direct, const async_write *w)
+{
+    const char *data = w->data;
+    uint64_t start = w->offset;
+    uint64_t end = w->offset + w->len;
+
+    if (!direct)
+        return job_add(job, cap, async_op_data, 0, start, data, w->len);
+
+    uint64_t a = (start + ASYNC_ALIGN - 1) / ASYNC_ALIGN * ASYNC_ALIGN;
+    uint64_t b = end / ASYNC_ALIGN * ASYNC_ALIGN;
+    if (a >= b)
+        return job_add(job, cap, async_op_data, 0, start, data, w->len);
+
+    if (a > start && job_add(job, cap, async_op_data, 0, start, data, a - start) != 0) return -1;
+    if (job_add(job, cap, async_op_data, 1, a, data + (a - start), b - a) != 0) return -1;
+    if (end > b && job_add(job, cap, async_op_data, 0, b, data + (b - start), end - b) != 0) return -1;
+    return 0;
+}
+
+static void job_done_locked(async_io *io, async_job *job)
+{
+    job->next = NULL;
+    if (io->done_tail) io->done_tail->next = job;
+    else io->done_head = job;
+    io->done_tail = job;
+}
+
+/* Called with lock held when the active job has nothing left in flight */
+static void job_finish_locked(async_io *io)
+{
+    async_job *job = io->active;
+    io->active = NULL;
+    job_done_locked(io, job);
+
+    /* Later headers must not commit records the failed flush never wrote */
+    if (job->error != 0)
+    {
+        job->cancels = 1;
+        io->failed = 1;
+    }
+    while (io->queue_head)
+    {
+        async_job *next = io->queue_head;
+        io->queue_head = next->next;
+        if (!io->queue_head) io->queue_tail = NULL;
+
+        if (!io->failed)
+        {
+            io->active = next;
+            break;
+        }
+        next->error = -ECANCELED;
+        job_done_locked(io, next);
+    }
+    pthread_cond_broadcast(&io->done_cv);
+    pthread_cond_broadcast(&io->wake);
+}
+
+static int op_fd(async_io *io, const async_op *op)
+{
+    return op->direct ? io->direct_fd : io->fd;
+}
+
+/* Record an op result; returns 1 if the job can be finished */
+static int job_complete_op(async_job *job, const async_op *op, ssize_t res)
+{
+    if (res >= 0 && op->kind != async_op_fsync && (size_t)res != op->len) res = -EIO;
+    /* Ops cancelled by a broken link must not hide the error that broke it */
+    if (res < 0 && (job->error == 0 || job->error == -ECANCELED)) job->error = (int)res;
+
+    job->inflight--;
+    return job->inflight == 0 && (job->next_op == job->nops || job->error != 0);
+}
+
+/* ---------- io_uring backend ---------- */
+
+static int uring_setup(async_uring *r, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    r->entries = p.sq_entries;
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+    {
+        if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) goto fail_fd;
+
+    r->cq_ptr = single ? r->sq_ptr
+                       : mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_ptr == MAP_FAILED) goto fail_sq;
+
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) goto fail_cq;
+
+    char *sq = r->sq_ptr;
+    char *cq = r->cq_ptr;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+
+fail_cq:
+    if (!single) munmap(r->cq_ptr, r->cq_size);
+fail_sq:
+    munmap(r->sq_ptr, r->sq_size);
+fail_fd:
+    close(r->fd);
+    return -1;
+}
+
+static void uring_teardown(async_uring *r)
+{
+    munmap(r->sqes, r->entries * sizeof(struct io_uring_sqe));
+    if (r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size);
+    munmap(r->sq_ptr, r->sq_size);
+    close(r->fd);
+}
+
+static int uring_enter(async_uring *r, unsigned submit, unsigned wait)
+{
+    for (;;)
+    {
+        long rc = syscall(__NR_io_uring_enter, r->fd, submit, wait,
+                          wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc >= 0) return (int)rc;
+        if (errno != EINTR) return -errno;
+    }
+}
+
+/* Submit the next batch of the active job as one linked chain */
+static void uring_pump(async_io *io)
+{
+    async_job *job = io->active;
+    async_uring *r = &io->ring;
+
+    while (job && job->inflight == 0)
+    {
+        if (job->error != 0 || job->next_op == job->nops)
+        {
+            job_finish_locked(io);
+            job = io->active;
+            continue;
+        }
+
+        unsigned tail = *r->sq_tail;
+        unsigned mask = *r->sq_mask;
+        size_t batch = job->nops - job->next_op;
+        if (batch > r->entries) batch = r->entries;
+
+        for (size_t k = 0; k < batch; k++)
+        {
+            size_t i = job->next_op + k;
+            const async_op *op = &job->ops[i];
+            unsigned idx = tail & mask;
+            struct io_uring_sqe *sqe = &r->sqes[idx];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->fd = op_fd(io, op);
+            sqe->user_data = i;
+            if (op->kind == async_op_fsync)
+            {
+                sqe->opcode = IORING_OP_FSYNC;
+            }
+            else
+            {
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->addr = (uint64_t)(uintptr_t)op->buf;
+                sqe->len = (uint32_t)op->len;
+                sqe->off = op->offset;
+            }
+            if (k + 1 < batch) sqe->flags = IOSQE_IO_LINK;
+
+            r->sq_array[idx] = idx;
+            tail++;
+        }
+        __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+        int rc = uring_enter(r, (unsigned)batch, 0);
+        size_t submitted = rc > 0 ? (size_t)rc : 0;
+        if (submitted < batch)
+        {
+            /* Unwind entries the kernel did not consume and fail the job */
+            __atomic_store_n(r->sq_tail, tail - (unsigned)(batch - submitted), __ATOMIC_RELEASE);
+            job->error = rc < 0 ? rc : -EIO;
+        }
+        job->next_op += submitted;
+        job->inflight = submitted;
+    }
+}
+
+/* Consume completions; returns 1 if any were seen */
+static int uring_reap(async_io *io)
+{
+    async_uring *r = &io->ring;
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    int seen = head != tail;
+
+    while (head != tail)
+    {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        async_job *job = io->active;
+        if (job && cqe->user_data < job->nops)
+            job_complete_op(job, &job->ops[cqe->user_data], cqe->res);
+        head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+    uring_pump(io);
+    return seen;
+}
+
+/* ---------- thread pool backend ---------- */
+
+/* Next op a worker may start, or NULL */
+static async_op *pool_take_locked(async_io *io, async_job **out_job)
+{
+    async_job *job = io->active;
+    if (!job || job->error != 0 || job->next_op == job->nops) return NULL;
+
+    async_op *op = &job->ops[job->next_op];
+    if (op->kind != async_op_data && job->inflight > 0) return NULL; // Barrier
+
+    job->next_op++;
+    job->inflight++;
+    *out_job = job;
+    return op;
+}
+
+static ssize_t pool_run_op(async_io *io, const async_op *op)
+{
+    if (op->kind == async_op_fsync)
+        return fsync(io->fd) == 0 ? 0 : -errno;
+
+    const char *buf = op->buf;
+    size_t left = op->len;
+    uint64_t off = op->offset;
+    while (left > 0)
+    {
+        ssize_t n = pwrite(op_fd(io, op), buf, left, (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -errno;
+        if (n == 0) return -EIO;
+        buf += n;
+        off += (uint64_t)n;
+        left -= (size_t)n;
+    }
+    return (ssize_t)op->len;
+}
+
+static void *pool_worker(void *arg)
+{
+    async_io *io = arg;
+
+    pthread_mutex_lock(&io->lock);
+    while (!io->stop)
+    {
+        async_job *job;
+        async_op *op = pool_take_locked(io, &job);
+        if (!op)
+        {
+            pthread_cond_wait(&io->wake, &io->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&io->lock);
+        ssize_t res = pool_run_op(io, op);
+        pthread_mutex_lock(&io->lock);
+
+        if (job_complete_op(job, op, res))
+            job_finish_locked(io);
+        else
+            pthread_cond_broadcast(&io->wake);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+/* ---------- public ---------- */
+
+static int open_direct(int fd)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return open(path, O_WRONLY | O_DIRECT);
+}
+
+async_io *async_create(int fd, int flags)
+{
+    if (fd < 0) return NULL;
+
+    async_io *io = calloc(1, sizeof(async_io));
+    if (!io) return NULL;
+
+    io->fd = fd;
+    io->direct_fd = -1;
+    if (flags & ASYNC_DIRECT)
+    {
+        io->direct_fd = open_direct(fd);
+        if (io->direct_fd < 0) { free(io); return NULL; }
+    }
+
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->wake, NULL);
+    pthread_cond_init(&io->done_cv, NULL);
+
+    if (!(flags & ASYNC_NO_URING) && uring_setup(&io->ring, ASYNC_QUEUE_DEPTH) == 0)
+    {
+        io->use_uring = 1;
+        return io;
+    }
+
+    for (; io->nthreads < ASYNC_POOL_THREADS; io->nthreads++)
+        if (pthread_create(&io->threads[io->nthreads], NULL, pool_worker, io) != 0)
+            break;
+    if (io->nthreads == 0)
+    {
+        async_destroy(io);
+        return NULL;
+    }
+    return io;
+}
+
+int async_uses_uring(const async_io *io)
+{
+    return io && io->use_uring;
+}
+
+int async_flush(async_io *io, const async_write *writes, size_t n,
+                const void *hdr, size_t hdr_len, async_callback cb, void *arg)
+{
+    if (!io || (n && !writes) || !hdr) return -1;
+
+    async_job *job = calloc(1, sizeof(async_job));
+    if (!job) return -1;
+    size_t cap = 0;
+
+    for (size_t i = 0; i < n; i++)
+        if (job_add_write(job, &cap, io->direct_fd >= 0, &writes[i]) != 0) goto fail;
+    if (job_add(job, &cap, async_op_header, 0, 0, hdr, hdr_len) != 0) goto fail;
+    if (job_add(job, &cap, async_op_fsync, 0, 0, NULL, 0) != 0) goto fail;
+    job->cb = cb;
+    job->arg = arg;
+
+    pthread_mutex_lock(&io->lock);
+    io->pending++;
+    if (io->failed)
+    {
+        job->error = -ECANCELED;
+        job_done_locked(io, job);
+        pthread_cond_broadcast(&io->done_cv);
+    }
+    else if (!io->active)
+        io->active = job;
+    else if (io->queue_tail)
+        io->queue_tail = io->queue_tail->next = job;
+    else
+        io->queue_head = io->queue_tail = job;
+
+    if (io->use_uring) uring_pump(io);
+    else pthread_cond_broadcast(&io->wake);
+    pthread_mutex_unlock(&io->lock);
+    return 0;
+
+fail:
+    job_free(job);
+    return -1;
+}
+
+int async_poll(async_io *io, int wait)
+{
+    if (!io) return 0;
+
+    pthread_mutex_lock(&io->lock);
+    if (io->use_uring)
+    {
+        uring_reap(io);
+        while (wait && !io->done_head && io->active)
+        {
+            if (uring_enter(&io->ring, 0, 1) < 0) break;
+            uring_reap(io);
+        }
+    }
+    else
+    {
+        while (wait && !io->done_head && (io->active || io->queue_head))
+            pthread_cond_wait(&io->done_cv, &io->lock);
+    }
+
+    async_job *done = io->done_head;
+    io->done_head = io->done_tail = NULL;
+    pthread_mutex_unlock(&io->lock);
+
+    int completed = 0, cleared = 0;
+    while (done)
+    {
+        async_job *next = done->next;
+        cleared |= done->cancels;
+        if (done->cb) done->cb(done->arg, done->error);
+        job_free(done);
+        completed++;
+        done = next;
+    }
+
+    if (completed)
+    {
+        pthread_mutex_lock(&io->lock);
+        io->pending -= (size_t)completed;
+        if (cleared) io->failed = 0;
+        pthread_mutex_unlock(&io->lock);
+    }
+    return completed;
+}
+
+size_t async_pending(async_io *io)
+{
+    if (!io) return 0;
+
+    pthread_mutex_lock(&io->lock);
+    size_t n = io->pending;
+    pthread_mutex_unlock(&io->lock);
+    return n;
+}
+
+void async_drain(async_io *io)
+{
+    while (async_pending(io) > 0)
+        if (async_poll(io, 1) == 0)
+            break;
+}
+
+void async_destroy(async_io *io)
+{
+    if (!io) return;
+
+    async_drain(io);
+
+    pthread_mutex_lock(&io->lock);
+    io->stop = 1;
+    pthread_cond_broadcast(&io->wake);
+    pthread_mutex_unlock(&io->lock);
+    for (int i = 0; i < io->nthreads; i++)
+        pthread_join(io->threads[i], NULL);
+
+    if (io->use_uring) uring_teardown(&io->ring);
+    if (io->direct_fd >= 0) close(io->direct_fd);
+    pthread_cond_destroy(&io->done_cv);
+    pthread_cond_destroy(&io->wake);
+    pthread_mutex_destroy(&io->lock);
+    free(io);
+}
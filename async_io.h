@@ -0,0 +1,66 @@
+/*
+* async_io.h
+ *
+ * Asynchronous write-back for the database file.
+ * Responsibilities:
+ * - Write dirty record ranges, then the header, then fsync, off the
+ *   calling thread.
+ * - Use io_uring with the three steps as linked operations; fall back to
+ *   a pwrite() thread pool when io_uring is unavailable.
+ * - Optionally write block-aligned ranges through an O_DIRECT descriptor.
+ * Notes:
+ * - Flushes complete in submission order. A failed write cancels the
+ *   header and fsync of its flush, and every flush queued behind it, or
+ *   submitted before its callback has run, completes with -ECANCELED.
+ * - Callbacks run on the thread calling async_poll() / async_drain().
+ */
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ASYNC_DIRECT   1   // Write aligned blocks with O_DIRECT
+#define ASYNC_NO_URING 2   // Always use the thread pool
+
+#define ASYNC_ALIGN 4096          // O_DIRECT buffer / offset alignment
+#define ASYNC_QUEUE_DEPTH 64      // io_uring submission entries
+#define ASYNC_POOL_THREADS 4      // Fallback pwrite workers
+
+/* result is 0 on success or a negative errno */
+typedef void (*async_callback)(void *arg, int result);
+
+typedef struct async_write {
+    uint64_t offset;
+    const void *data;
+    size_t len;
+} async_write;
+
+struct async_io;
+typedef struct async_io async_io;
+
+/* Attach to an open database descriptor. The descriptor stays owned by the caller. */
+async_io *async_create(int fd, int flags);
+
+/* 1 if the io_uring backend is in use, 0 for the thread pool. */
+int async_uses_uring(const async_io *io);
+
+/* Queue writes, then header at offset 0, then fsync. Data is copied before return. */
+int async_flush(async_io *io, const async_write *writes, size_t n,
+                const void *hdr, size_t hdr_len, async_callback cb, void *arg);
+
+/* Run callbacks of finished flushes. wait = 1 blocks until one finishes.
+ * Returns the number of flushes completed. */
+int async_poll(async_io *io, int wait);
+
+/* Flushes queued or in flight. */
+size_t async_pending(async_io *io);
+
+/* Wait for every queued flush and run its callback. */
+void async_drain(async_io *io);
+
+/* Drain and free. */
+void async_destroy(async_io *io);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+* load_bench.c
+ *
+ * Times engine_load() against engine_load_parallel() for 1..N threads,
+ * from the start of the load to the first successful lookup.
+ * Usage: load_bench [records] [max_threads] [runs]
+ *   records      records in the generated database (default 99000)
+ *   max_threads  highest thread count to try (default: cores, at least 8)
+ *   runs         runs per configuration, the median is reported (default 5)
+ * Build from the repository root:
+ *   cc -std=gnu11 -O2 -pthread -I. -o load_bench bench/load_bench.c \
+ *      engine.c indexhash.c indexfile.c metrics.c file_header.c wal.c \
+ *      async_io.c replication.c namepool.c parallel_load.c
+ * Notes:
+ * - Both the index rebuild (sidecar removed) and the sidecar path are timed.
+ * - Each run loads in a fresh child process, like a real startup; runs in
+ *   one process would inherit the allocator state of the previous ones.
+ * - Speedup and efficiency are relative to the serial engine_load().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "engine.h"
+#include "indexfile.h"
+#include "parallel_load.h"
+
+#define BENCH_DB "/tmp/load_bench.db"
+#define BENCH_MAX_RUNS 64
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* 50k distinct names, every 7th record deleted */
+static int build_db(size_t records)
+{
+    unlink(BENCH_DB);
+    char *idx = indexfile_path(BENCH_DB);
+    if (idx) unlink(idx);
+    free(idx);
+
+    engine *e = engine_create(records + 1);
+    if (!e || engine_load(e, BENCH_DB) != 0) { engine_destroy(e); return -1; }
+
+    char name[64];
+    for (size_t i = 0; i < records; i++)
+    {
+        snprintf(name, sizeof(name), "/usr/bin/proc-%zu", i % 50000);
+        if (engine_add(e, name) != 0) { engine_destroy(e); return -1; }
+    }
+    for (size_t i = 0; i < records; i += 7)
+    {
+        snprintf(name, sizeof(name), "/usr/bin/proc-%zu", i % 50000);
+        engine_delete(e, name);
+    }
+
+    int rc = engine_save(e);
+    engine_destroy(e);
+    return rc;
+}
+
+/* One load and lookup in a child process; ms, or -1 on failure */
+static double time_one(size_t records, unsigned int threads)
+{
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        engine *e = engine_create(records + 1);
+        double t0 = now_ms();
+        int rc = threads ? engine_load_parallel(e, BENCH_DB, threads) : engine_load(e, BENCH_DB);
+        Processrecord *found = rc == 0 ? engine_find(e, "/usr/bin/proc-1") : NULL;
+        double ms = now_ms() - t0;
+        if (!found || e->count != records) ms = -1;
+        if (write(fds[1], &ms, sizeof(ms)) != (ssize_t)sizeof(ms)) _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    double ms = -1;
+    if (pid < 0 || read(fds[0], &ms, sizeof(ms)) != (ssize_t)sizeof(ms)) ms = -1;
+    close(fds[0]);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    return ms;
+}
+
+/* Median time to the first lookup; threads = 0 means engine_load() */
+static double time_load(size_t records, unsigned int threads, int runs, int keep_sidecar)
+{
+    double t[BENCH_MAX_RUNS];
+    char *idx = indexfile_path(BENCH_DB);
+    char *saved = NULL;
+    if (idx && !keep_sidecar)
+    {
+        saved = malloc(strlen(idx) + sizeof(".off"));
+        if (saved) { strcpy(saved, idx); strcat(saved, ".off"); rename(idx, saved); }
+    }
+
+    for (int r = 0; r < runs; r++)
+    {
+        t[r] = time_one(records, threads);
+        if (t[r] < 0) { fprintf(stderr, "load failed\n"); exit(1); }
+    }
+
+    if (saved) { rename(saved, idx); free(saved); }
+    free(idx);
+    qsort(t, runs, sizeof(double), cmp_double);
+    return t[runs / 2];
+}
+
+static void report(size_t records, unsigned int max_threads, int runs, int keep_sidecar)
+{
+    double serial = time_load(records, 0, runs, keep_sidecar);
+    printf("%s\n", keep_sidecar ? "sidecar index" : "index rebuild");
+    printf("  %-10s %10s %9s %11s\n", "threads", "ms", "speedup", "efficiency");
+    printf("  %-10s %10.2f %9s %11s\n", "serial", serial, "1.00", "-");
+
+    for (unsigned int th = 1; th <= max_threads; th *= 2)
+    {
+        double ms = time_load(records, th, runs, keep_sidecar);
+        printf("  %-10u %10.2f %9.2f %10.0f%%\n", th, ms, serial / ms, 100.0 * serial / ms / th);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 99000;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int max_threads = argc > 2 ? (unsigned int)atoi(argv[2]) : (cores > 8 ? (unsigned int)cores : 8);
+    int runs = argc > 3 ? atoi(argv[3]) : 5;
+    if (records == 0 || records >= MAX_RECORDS) records = MAX_RECORDS - 1;
+    if (max_threads < 1) max_threads = 1;
+    if (runs < 1) runs = 1;
+    if (runs > BENCH_MAX_RUNS) runs = BENCH_MAX_RUNS;
+
+    if (build_db(records) != 0) { fprintf(stderr, "cannot build %s\n", BENCH_DB); return 1; }
+    printf("%zu records, %ld cores, median of %d runs\n", records, cores, runs);
+    report(records, max_threads, runs, 0);
+    report(records, max_threads, runs, 1);
+
+    unlink(BENCH_DB);
+    char *idx = indexfile_path(BENCH_DB);
+    if (idx) unlink(idx);
+    free(idx);
+    return 0;
+}
@@ -6,6 +6,11 @@
 
 #include "engine.h"
 #include "indexhash.h"
+#include "indexfile.h"
+#include "metrics.h"
+#include "async_io.h"
+#include "replication.h"
+#include "namepool.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -20,6 +25,8 @@ engine *engine_create(size_t init_capacity)
     e->capacity = init_capacity;
     e->process = calloc(init_capacity, sizeof(Processrecord));
     if (!e->process) goto fail;
+    e->names = namepool_create(init_capacity);
+    if (!e->names) goto fail;
     e->index = hash_create(init_capacity);
 
     if (wal_init(&e->wal, &e->wal_size, &e->wal_capacity) != 0)
@@ -31,21 +38,33 @@ engine *engine_create(size_t init_capacity)
         return NULL;
     }
 }
-/* Load file and rebuild index */
+/* Load file; use the sidecar index and names if they match, else intern and rebuild */
 int engine_load(engine *e, const char *path)
 {
     if (!e || !path) return -1;
     e->fb = file_open(path, &e->hdr);
     if (!e->fb) return -1;
-    if (read_all_file(e->fb,e->hdr.record_count,e->process)!= 0) {close_file(e->fb, &e->hdr);return -1;}
+    if (e->hdr.record_count > e->capacity) {close_file(e->fb, &e->hdr);e->fb = NULL;return -1;}
+    Processdiskrecord *disk = malloc((e->hdr.record_count ? e->hdr.record_count : 1) * sizeof(Processdiskrecord));
+    if (!disk || read_all_file(e->fb,e->hdr.record_count,disk)!= 0) {free(disk);close_file(e->fb, &e->hdr);e->fb = NULL;return -1;}
+    uint64_t checksum = records_checksum(disk, 0, e->hdr.record_count);
+    int mapped = engine_attach_index(e, path, checksum) == 0;
+    const uint32_t *ids = mapped && indexmap_load_names(e->index_map, e->names, disk) == 0 ? e->index_map->name_ids : NULL;
+    for (uint64_t i = 0; i < e->hdr.record_count; i++)
+    {
+        if (ids) {record_from_disk_id(&disk[i], ids[i], &e->process[i]);continue;}
+        if (record_from_disk(e->names, &disk[i], &e->process[i]) != 0) {free(disk);close_file(e->fb, &e->hdr);e->fb = NULL;return -1;}
+    }
+    free(disk);
+    e->count = e->hdr.record_count;
+    if (mapped) return 0;
     if (e->hdr.record_count > 0)
     {
-        e->count = e->hdr.record_count;
         for (uint64_t i = 0; i < e->count; i++)
         {
             if (e->process[i].alive)
             {
-                insert_index(e->process[i].name,e,i);
+                insert_index(e->process[i].name_id,e,i);
             }
         }
     }
@@ -55,8 +74,14 @@ int engine_load(engine *e, const char *path)
 void engine_destroy(engine *e)
 {
     if (!e) return;
+    repl_primary_stop(e->repl);
+    async_destroy(e->aio); // Finish pending flushes before the file closes
     if (e->fb) close_file(e->fb, &e->hdr);
     if (e->index) destroy_index(e);
+    indexmap_close(e->index_map);
+    free(e->index_path);
+    metric_store_destroy(e->metrics);
+    namepool_destroy(e->names);
     wal_free(&e->wal);
     free(e->process);
     free(e);
@@ -66,22 +91,24 @@ void engine_destroy(engine *e)
 int engine_add(engine *e, const char *name)
 {
     if (e->capacity == e->count) return -1;
-    
-    wal_append(&e->wal, &e->wal_size, &e->wal_capacity, wal_add, r->pid);
+
+    uint32_t name_id = name_intern(e->names, name);
+    if (name_id == NAME_NONE) return -1;
     
     Processrecord *r = &e->process[e->count];
     r->pid = e->count;
-    strncpy(r->name, name, sizeof(r->name));
-    r->name[sizeof(r->name)-1] = '\0';
+    engine_log(e, wal_add, r->pid);
+
+    r->name_id = name_id;
     r->cpu = rand() %60;
     r->ram = rand() %80;
     r->alive = 1;
         e->count++;
     e->dirty = 1;
 
-    if(insert_index(name, e, r->pid)!= 0)
+    if(insert_index(name_id, e, r->pid)!= 0)
         return -1;
-    wal_append(&e->wal, &e->wal_size, &e->wal_capacity, wal_committed, r->pid); // 
+    engine_log(e, wal_committed, r->pid);
     
     return 0;
 }
@@ -93,20 +120,30 @@ Processrecord *engine_find(engine *e, const char *name)
     return &e->process[idx];
 }
 
+/* Name of a record; valid until the next add or delete */
+const char *engine_name(engine *e, const Processrecord *rec)
+{
+    if (!e || !rec) return "";
+    return name_str(e->names, rec->name_id);
+}
+
 /* Logical delete process and update WAL */
 int engine_delete(engine *e, const char *name)
 {
     if(!name || !e) return -1;
     
-    wal_append(&e->wal, &e->wal_size, &e->wal_capacity, wal_delete, idx);
-    
     uint64_t idx;
     if (find_index(name, e, &idx) != 0) return -1;
 
+    engine_log(e, wal_delete, idx);
+
     e->process[idx].alive = 0;
     if(remove_index(name, e,&idx)!= 0) return -1;
+    name_release(e->names, e->process[idx].name_id);
+    e->process[idx].name_id = NAME_NONE;
+    metric_store_drop(e->metrics, idx);
 
-    wal_append(&e->wal,&e->wal_size,&e->wal_capacity,wal_committed,idx)
+    engine_log(e, wal_committed, idx);
     
     e->dirty = 1;
     return 0;
@@ -121,7 +158,7 @@ Processrecord *engine_get(engine *e)
     {
         Processrecord *rec = &e->process[i];
         if (rec->alive)
-            printf("Name: %s\tPID: %lu\tCPU: %u\tRAM: %u\n",rec->name,rec->pid,
+            printf("Name: %s\tPID: %lu\tCPU: %u\tRAM: %u\n",engine_name(e, rec),rec->pid,
                 rec->cpu, rec->ram);
     }
     return e->process;
@@ -134,24 +171,220 @@ int engine_flush(engine *e)
     return 0;
 }
 
-/* Save engine state to file */
-int engine_save(engine *e)
+/* Write all records and header */
+static int engine_write_file(engine *e)
 {
-    if (!e || !e->fb || !e->process) return -1;
-
     fseek(e->fb, sizeof(file_header), SEEK_SET); // تجاوز header
     for(size_t i = 0; i < e->count; i++)
     {
-        if(fwrite(&e->process[i], sizeof(Processrecord), 1, e->fb) != 1)
+        Processdiskrecord d;
+        record_to_disk(e->names, &e->process[i], &d);
+        if(fwrite(&d, sizeof(Processdiskrecord), 1, e->fb) != 1)
             return -1;
     }
     if(fflush(e->fb)!= 0) return -1;
 
     e->hdr.record_count = e->count;
     commit_file(e->fb, &e->hdr);
+    return 0;
+}
+
+/* Save engine state to file */
+int engine_save(engine *e)
+{
+    if (!e || !e->fb || !e->process) return -1;
+    async_drain(e->aio);
+
+    /* Followers snapshot the file: keep them out while it is rewritten */
+    repl_checkpoint_begin(e->repl);
+    int rc = engine_write_file(e);
+    repl_checkpoint_end(e->repl, rc == 0, e->lsn);
+    if (rc != 0) return -1;
+
+    if (e->index_path) indexfile_write(e->index_path, e);
+    e->checkpoint_lsn = e->lsn;
+    e->failed_lsn = 0;
+    wal_discard(&e->wal, &e->wal_size, &e->wal_capacity, e->wal_size);
+    e->wal_synced = 0;
+    e->dirty = 0;
+    return 0;
+
+}
+
+/* Attach async write-back to the open file (flags: ASYNC_DIRECT, ASYNC_NO_URING) */
+int engine_async_enable(engine *e, int flags)
+{
+    if (!e || !e->fb) return -1;
+    if (e->aio) return 0;
+
+    e->aio = async_create(fileno(e->fb), flags);
+    return e->aio ? 0 : -1;
+}
+
+typedef struct engine_save_ctx {
+    engine *e;
+    async_callback cb;
+    void *arg;
+    uint64_t first_lsn; // First LSN covered by this flush
+    uint64_t lsn; // Last LSN covered by this flush
+} engine_save_ctx;
+
+/* Index of the first WAL entry at or after lsn */
+static size_t wal_position(const engine *e, uint64_t lsn)
+{
+    size_t lo = 0, hi = e->wal_size;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (e->wal[mid].lsn < lsn) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Forget WAL entries up to lsn once the file holds them */
+static void wal_compact(engine *e, uint64_t lsn)
+{
+    size_t n = wal_position(e, lsn + 1);
+    if (n > e->wal_synced) n = e->wal_synced;
+
+    wal_discard(&e->wal, &e->wal_size, &e->wal_capacity, n);
+    e->wal_synced -= n;
+}
+
+static void engine_save_done(void *arg, int result)
+{
+    engine_save_ctx *c = arg;
+    engine *e = c->e;
+
+    if (result != 0)
+    {
+        /* Make the next save write these records again */
+        size_t start = wal_position(e, c->first_lsn);
+        e->dirty = 1;
+        if (e->wal_synced > start) e->wal_synced = start;
+        if (e->failed_lsn == 0 || c->first_lsn < e->failed_lsn) e->failed_lsn = c->first_lsn;
+    }
+    else if (e->failed_lsn == 0 || c->first_lsn <= e->failed_lsn)
+    {
+        /* Only a save that rewrote what the failed one missed moves the checkpoint */
+        e->failed_lsn = 0;
+        if (c->lsn > e->checkpoint_lsn) e->checkpoint_lsn = c->lsn;
+        repl_checkpoint_begin(e->repl);
+        repl_checkpoint_end(e->repl, 1, c->lsn);
+        wal_compact(e, c->lsn);
+    }
+
+    if (c->cb) c->cb(c->arg, result);
+    free(c);
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Contiguous runs of records changed in the WAL since the last save,
+ * converted into *out_disk (freed by the caller once flushed).
+ * Sized by the unsaved WAL tail, not the record count. */
+static async_write *engine_dirty_ranges(engine *e, size_t *out_n, Processdiskrecord **out_disk)
+{
+    *out_n = 0;
+    *out_disk = NULL;
+
+    size_t tail = e->wal_size - e->wal_synced;
+    uint64_t *idx = malloc((tail ? tail : 1) * sizeof(uint64_t));
+    if (!idx) return NULL;
+
+    size_t k = 0;
+    for (size_t i = e->wal_synced; i < e->wal_size; i++)
+    {
+        if (e->wal[i].type != wal_committed && e->wal[i].record_index < e->count)
+            idx[k++] = e->wal[i].record_index;
+    }
+    qsort(idx, k, sizeof(uint64_t), cmp_index);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < k; i++)
+        if (unique == 0 || idx[unique - 1] != idx[i])
+            idx[unique++] = idx[i];
+
+    async_write *writes = malloc((unique ? unique : 1) * sizeof(async_write));
+    Processdiskrecord *disk = writes ? malloc((unique ? unique : 1) * sizeof(Processdiskrecord)) : NULL;
+    if (!disk) { free(idx); free(writes); return NULL; }
+
+    size_t n = 0;
+    for (size_t i = 0; i < unique; )
+    {
+        size_t first = i;
+        writes[n].data = &disk[i];
+        do
+            record_to_disk(e->names, &e->process[idx[i]], &disk[i]);
+        while (++i < unique && idx[i] == idx[i - 1] + 1);
+
+        writes[n].offset = sizeof(file_header) + idx[first] * sizeof(Processdiskrecord);
+        writes[n].len = (i - first) * sizeof(Processdiskrecord);
+        n++;
+    }
+
+    free(idx);
+    *out_n = n;
+    *out_disk = disk;
+    return writes;
+}
+
+/* Queue dirty records, header commit and fsync without blocking */
+int engine_save_async(engine *e, async_callback cb, void *arg)
+{
+    if (!e || !e->fb || !e->process) return -1;
+    if (!e->aio && engine_async_enable(e, 0) != 0) return -1;
+
+    engine_save_ctx *c = malloc(sizeof(engine_save_ctx));
+    if (!c) return -1;
+    c->e = e;
+    c->cb = cb;
+    c->arg = arg;
+    c->first_lsn = e->wal_synced < e->wal_size ? e->wal[e->wal_synced].lsn : e->lsn + 1;
+    c->lsn = e->lsn;
+
+    size_t n;
+    Processdiskrecord *disk;
+    async_write *writes = engine_dirty_ranges(e, &n, &disk);
+    if (!writes) { free(c); return -1; }
+
+    e->hdr.record_count = e->count;
+    int rc = async_flush(e->aio, writes, n, &e->hdr, sizeof(file_header), engine_save_done, c);
+    free(writes);
+    free(disk);
+    if (rc != 0) { free(c); return -1; }
+
+    e->wal_synced = e->wal_size;
     e->dirty = 0;
     return 0;
+}
+
+/* Append to WAL with the next LSN; committed changes are shipped to followers */
+int engine_log(engine *e, enum waltype type, uint64_t record_index)
+{
+    if (!e) return -1;
+    if (wal_append(&e->wal, &e->wal_size, &e->wal_capacity, type, record_index) != 0) return -1;
+
+    e->wal[e->wal_size - 1].lsn = ++e->lsn;
+    if (e->repl && (type == wal_committed || type == wal_update) && record_index < e->count)
+    {
+        Processdiskrecord d;
+        record_to_disk(e->names, &e->process[record_index], &d);
+        repl_publish(e->repl, e->lsn, type, record_index, &d);
+    }
+    return 0;
+}
 
+/* Run callbacks of finished async saves */
+int engine_poll(engine *e, int wait)
+{
+    if (!e) return 0;
+    return async_poll(e->aio, wait);
 }
 
 
@@ -5,7 +5,11 @@
 *
 * Responsibilities:
 * - Manages all process in RAM
+* - Stores each distinct name once; records hold name ids (namepool.h).
 * - Maintains a hash index for fast name lookups.
+* - Persists the index next to the database so unchanged files load without a rebuild.
+* - Optionally keeps bounded CPU/RAM history per process (metrics.h).
+* - Optionally ships its WAL to read-only followers (replication.h).
 * - Tracks changes with a WAL (Write-Ahead Log) for crash recovery.
 * - Persists data to disk when needed (engine_save / engine_flush).
 *
@@ -18,7 +22,9 @@
  * 1. engine_create() to initialize engine.
  * 2. engine_load() to load existing database.
  * 3. engine_add / engine_delete to modify processes.
- * 4. engine_flush / engine_save to persist changes.
+ * 4. engine_flush / engine_save to persist changes, or engine_save_async
+ *    followed by engine_poll to persist without blocking (the sidecar
+ *    index is then only rewritten by an explicit engine_save_index).
  * 5. engine_destroy() to free resources.
  */
 
@@ -29,10 +35,19 @@
 #include "processrecord.h"
 #include "file_header.h"
 #include "wal.h"
+#include "async_io.h"
 #define MAX_RECORDS 100000
 
 struct indextable;
 typedef struct indextable indextable;
+struct indexmap;
+typedef struct indexmap indexmap;
+struct metric_store;
+typedef struct metric_store metric_store;
+struct repl_primary;
+typedef struct repl_primary repl_primary;
+struct namepool;
+typedef struct namepool namepool;
 
 /*
  * engine
@@ -51,12 +66,24 @@ typedef struct engine {
     Processrecord *process; // pointer to Processsrecord.h
     size_t count; // Used operations
     size_t capacity; // Capacity process
+    namepool *names; // Interned process names
 
     indextable *index;
+    indexmap *index_map; // Index mapped from the sidecar file, NULL if rebuilt
+    char *index_path; // Sidecar index written on save
 
     walenter *wal;
     size_t wal_size; // Used operations
     size_t wal_capacity; // Capacity wal
+    size_t wal_synced; // WAL entries already queued for the file; dropped once durable
+    uint64_t lsn; // Last log sequence number assigned
+    uint64_t checkpoint_lsn; // Last LSN the data file reflects
+    uint64_t failed_lsn; // First LSN a failed async save left unwritten, 0 if none
+
+    async_io *aio; // Async write-back, NULL until enabled
+    repl_primary *repl; // WAL shipping to followers, NULL unless replicating
+
+    metric_store *metrics; // Per-record CPU/RAM history, NULL until enabled
 
     int dirty; // dirty = 1 There are changes dirty = 0 No changes
 } engine;
@@ -67,7 +94,12 @@ void engine_destroy(engine *e);
 Processrecord *engine_get(engine *e);
 int engine_add(engine *e, const char *name);
 Processrecord *engine_find(engine *e, const char *name);
+const char *engine_name(engine *e, const Processrecord *rec);
 int engine_delete(engine *e, const char *name);
 int engine_flush(engine *e);
 int engine_save(engine *e);
+int engine_log(engine *e, enum waltype type, uint64_t record_index);
+int engine_async_enable(engine *e, int flags);
+int engine_save_async(engine *e, async_callback cb, void *arg);
+int engine_poll(engine *e, int wait);
 #endif
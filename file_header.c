@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include "file_header.h"
 #include "processrecord.h"
 
@@ -49,7 +50,7 @@ FILE *file_open(const char *path, file_header *hdr)
 }
 
 /* Append a process record and update header in file. */
-int write_file_record(FILE *fb, file_header *hdr, Processrecord *rec)
+int write_file_record(FILE *fb, file_header *hdr, Processdiskrecord *rec)
 {
     if (!fb || !hdr || !rec) return -1;
 
@@ -57,33 +58,64 @@ int write_file_record(FILE *fb, file_header *hdr, Processrecord *rec)
     if (fwrite(hdr, sizeof(file_header), 1, fb) != 1) return -1;
 
     fseek(fb, 0, SEEK_END);           // Append record
-    if (fwrite(rec, sizeof(Processrecord), 1, fb) != 1) return -1;
+    if (fwrite(rec, sizeof(Processdiskrecord), 1, fb) != 1) return -1;
 
     fflush(fb);
     return 0;
 }
 
-/* Read all process records from file into RAM. */
-int read_all_file(FILE *fb, uint64_t record_count, Processrecord *out)
+/* Read all process records from file. */
+int read_all_file(FILE *fb, uint64_t record_count, Processdiskrecord *out)
 {
     if (!fb || !out) return -1;
 
     fseek(fb, sizeof(file_header), SEEK_SET);
-    size_t read = fread(out, sizeof(Processrecord), record_count, fb);
+    size_t read = fread(out, sizeof(Processdiskrecord), record_count, fb);
     return read == record_count ? 0 : -1;
 }
 
 /* Update a specific record at given index. */
-int update_file(FILE *fb, uint64_t index, Processrecord *rec)
+int update_file(FILE *fb, uint64_t index, Processdiskrecord *rec)
 {
     if (!fb || !rec) return -1;
 
-    if (fseek(fb, sizeof(file_header) + index * sizeof(Processrecord), SEEK_SET) != 0) return -1;
-    if (fwrite(rec, sizeof(Processrecord), 1, fb) != 1) return -1;
+    if (fseek(fb, sizeof(file_header) + index * sizeof(Processdiskrecord), SEEK_SET) != 0) return -1;
+    if (fwrite(rec, sizeof(Processdiskrecord), 1, fb) != 1) return -1;
     fflush(fb);
     return 0;
 }
 
+/* Expand the name id; zero padding keeps file checksums stable. */
+void record_to_disk(const namepool *names, const Processrecord *rec, Processdiskrecord *out)
+{
+    memset(out, 0, sizeof(Processdiskrecord));
+    strncpy(out->name, name_str(names, rec->name_id), sizeof(out->name) - 1);
+    out->pid = rec->pid;
+    out->cpu = rec->cpu;
+    out->ram = rec->ram;
+    out->alive = rec->alive;
+}
+
+/* Intern the name of an alive record. */
+int record_from_disk(namepool *names, const Processdiskrecord *rec, Processrecord *out)
+{
+    record_from_disk_id(rec, NAME_NONE, out);
+    if (!rec->alive) return 0;
+
+    out->name_id = name_intern(names, rec->name); // Reads at most PROCESS_NAME_LEN - 1 bytes
+    return out->name_id != NAME_NONE ? 0 : -1;
+}
+
+/* Sidecar load: the pool already holds the name. */
+void record_from_disk_id(const Processdiskrecord *rec, uint32_t name_id, Processrecord *out)
+{
+    out->pid = rec->pid;
+    out->name_id = rec->alive ? name_id : NAME_NONE;
+    out->cpu = rec->cpu;
+    out->ram = rec->ram;
+    out->alive = rec->alive;
+}
+
 /* Commit header changes to file to ensure consistency. */
 void commit_file(FILE *fb, file_header *hdr)
 {
@@ -5,6 +5,7 @@
  * Responsibilities:
  * - Define file_header structure.
  * - Declare functions to open, read, write, update, commit, and close the database.
+ * - Convert records between their RAM and file layouts.
  * Notes:
  * - Always use close_file() to safely persist changes.
  */
@@ -15,6 +16,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include "processrecord.h"
+#include "namepool.h"
 
 #define MAGIC 1162757961
 #define VERSION 1
@@ -30,13 +32,22 @@ typedef struct file_header {
 FILE *file_open(const char *path, file_header *hdr);
 
 /* Append a process record to the file and update header. */
-int write_file_record(FILE *fb, file_header *hdr, Processrecord *rec);
+int write_file_record(FILE *fb, file_header *hdr, Processdiskrecord *rec);
 
-/* Read all process records into RAM. */
-int read_all_file(FILE *fb, uint64_t record_count, Processrecord *out);
+/* Read all process records as stored in the file. */
+int read_all_file(FILE *fb, uint64_t record_count, Processdiskrecord *out);
 
 /* Update a specific process record at the given index. */
-int update_file(FILE *fb, uint64_t index, Processrecord *rec);
+int update_file(FILE *fb, uint64_t index, Processdiskrecord *rec);
+
+/* File image of rec; deleted records are stored without a name. */
+void record_to_disk(const namepool *names, const Processrecord *rec, Processdiskrecord *out);
+
+/* RAM record from a file image, interning the name of alive records. */
+int record_from_disk(namepool *names, const Processdiskrecord *rec, Processrecord *out);
+
+/* RAM record from a file image whose name is already interned as name_id. */
+void record_from_disk_id(const Processdiskrecord *rec, uint32_t name_id, Processrecord *out);
 
 /* Commit header changes to file. */
 void commit_file(FILE *fb, file_header *hdr);
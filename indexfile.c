@@ -0,0 +1,403 @@
+/*
+* indexfile.c
+ *
+ * Implements the persisted hash index.
+ * Responsibilities:
+ * - Write the sidecar atomically (temp file + rename) on save.
+ * - Validate and mmap it on load so startup skips the index rebuild.
+ * - Serve find/remove from the mapping; new inserts stay in the
+ *   in-memory table, which is always searched first.
+ */
+
+#include "indexfile.h"
+#include "indexhash.h"
+#include "namepool.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Finalizer from MurmurHash3 */
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Fold len bytes into h, a word at a time */
+static inline uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t off = 0;
+
+    for (; off + sizeof(uint64_t) <= len; off += sizeof(uint64_t))
+    {
+        uint64_t w;
+        memcpy(&w, p + off, sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+        h = (h << 31) | (h >> 33);
+    }
+    for (; off < len; off++)
+        h = (h ^ p[off]) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Hash of one file record seeded with its position */
+static uint64_t record_checksum(const Processdiskrecord *rec, uint64_t i)
+{
+    return mix64(hash_bytes((i + 1) * 0x9e3779b97f4a7c15ULL, rec, sizeof(Processdiskrecord)));
+}
+
+/* Sections after the header, in file order */
+enum { SIDECAR_SECTIONS = 5 };
+
+typedef struct sidecar_section {
+    const void *data;
+    uint64_t len;
+} sidecar_section;
+
+/* Hash of the sidecar body; each section is folded separately so the
+ * writer can hash its buffers and the reader the mapping */
+static uint64_t body_checksum(const sidecar_section *s)
+{
+    uint64_t h = INDEXFILE_MAGIC;
+    for (int i = 0; i < SIDECAR_SECTIONS; i++)
+        h = mix64(hash_bytes(h ^ s[i].len, s[i].data, (size_t)s[i].len));
+    return h;
+}
+
+/* Sum of per-record hashes */
+uint64_t records_checksum(const Processdiskrecord *rec, uint64_t first, uint64_t last)
+{
+    if (!rec) return 0;
+
+    uint64_t sum = 0;
+    for (uint64_t i = first; i < last; i++)
+        sum += record_checksum(&rec[i], i);
+    return sum;
+}
+
+/* records_checksum() of the file engine_save() writes from e */
+static uint64_t engine_checksum(engine *e)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < e->count; i++)
+    {
+        Processdiskrecord d;
+        record_to_disk(e->names, &e->process[i], &d);
+        sum += record_checksum(&d, i);
+    }
+    return sum;
+}
+
+/* "<db_path>.idx" */
+char *indexfile_path(const char *db_path)
+{
+    if (!db_path) return NULL;
+
+    size_t len = strlen(db_path);
+    char *path = malloc(len + sizeof(".idx"));
+    if (!path) return NULL;
+
+    memcpy(path, db_path, len);
+    memcpy(path + len, ".idx", sizeof(".idx"));
+    return path;
+}
+
+/* Pool table with refcounts of the saved records, and each record's id */
+static int name_tables(engine *e, name_entry **out_names, uint32_t **out_ids)
+{
+    const namepool *pool = e->names;
+    name_entry *names = calloc(pool->count, sizeof(name_entry));
+    uint32_t *ids = malloc((e->count ? e->count : 1) * sizeof(uint32_t));
+    if (!names || !ids) { free(names); free(ids); return -1; }
+
+    for (uint32_t id = 1; id < pool->count; id++)
+    {
+        names[id].offset = pool->entries[id].offset;
+        names[id].hash = pool->entries[id].hash;
+    }
+
+    /* Ids held by nothing but live callers load as free */
+    for (size_t i = 0; i < e->count; i++)
+    {
+        ids[i] = e->process[i].alive ? e->process[i].name_id : NAME_NONE;
+        if (ids[i] != NAME_NONE) names[ids[i]].refcount++;
+    }
+
+    *out_names = names;
+    *out_ids = ids;
+    return 0;
+}
+
+/* Write index of alive records and the name pool to a temp file, then rename over path */
+int indexfile_write(const char *path, engine *e)
+{
+    if (!path || !e || !e->process || !e->index || !e->names) return -1;
+
+    uint64_t buckets = e->index->bucket_count;
+    uint64_t *start = calloc(buckets + 1, sizeof(uint64_t));
+    if (!start) return -1;
+
+    /* Count entries per bucket, then prefix-sum into CSR offsets */
+    uint64_t alive = 0;
+    for (size_t i = 0; i < e->count; i++)
+    {
+        if (!e->process[i].alive) continue;
+        start[name_hash_of(e->names, e->process[i].name_id) % buckets + 1]++;
+        alive++;
+    }
+    for (uint64_t b = 0; b < buckets; b++)
+        start[b + 1] += start[b];
+
+    uint64_t *entries = malloc((alive ? alive : 1) * sizeof(uint64_t));
+    uint64_t *cursor = malloc(buckets * sizeof(uint64_t));
+    if (!entries || !cursor) { free(start); free(entries); free(cursor); return -1; }
+    memcpy(cursor, start, buckets * sizeof(uint64_t));
+
+    /* Newest first, matching the head insertion order of the hash table */
+    for (size_t i = e->count; i-- > 0; )
+    {
+        if (!e->process[i].alive) continue;
+        entries[cursor[name_hash_of(e->names, e->process[i].name_id) % buckets]++] = i;
+    }
+    free(cursor);
+
+    indexfile_header hdr = {0};
+    hdr.magic = INDEXFILE_MAGIC;
+    hdr.version = INDEXFILE_VERSION;
+    hdr.bucket_count = buckets;
+    hdr.entry_count = alive;
+    hdr.bucket_offset = sizeof(indexfile_header);
+    hdr.entry_offset = hdr.bucket_offset + (buckets + 1) * sizeof(uint64_t);
+    hdr.record_count = e->hdr.record_count;
+    hdr.date_start = e->hdr.date_start;
+    hdr.checksum = engine_checksum(e);
+
+    const namepool *pool = e->names;
+    name_entry *names = NULL;
+    uint32_t *ids = NULL;
+    hdr.name_count = pool->count;
+    hdr.name_offset = hdr.entry_offset + alive * sizeof(uint64_t);
+    hdr.name_id_offset = hdr.name_offset + hdr.name_count * sizeof(name_entry);
+    hdr.arena_len = pool->arena_len;
+    hdr.arena_offset = hdr.name_id_offset + e->count * sizeof(uint32_t);
+
+    char *tmp = malloc(strlen(path) + sizeof(".tmp"));
+    if (!tmp || name_tables(e, &names, &ids) != 0) { free(tmp); free(start); free(entries); return -1; }
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+
+    sidecar_section body[SIDECAR_SECTIONS] = {
+        { start, (buckets + 1) * sizeof(uint64_t) },
+        { entries, alive * sizeof(uint64_t) },
+        { names, hdr.name_count * sizeof(name_entry) },
+        { ids, e->count * sizeof(uint32_t) },
+        { pool->arena, hdr.arena_len },
+    };
+    hdr.body_checksum = body_checksum(body);
+
+    int rc = -1;
+    FILE *fb = fopen(tmp, "wb");
+    if (fb)
+    {
+        if (fwrite(&hdr, sizeof(hdr), 1, fb) == 1 &&
+            fwrite(start, sizeof(uint64_t), buckets + 1, fb) == buckets + 1 &&
+            fwrite(entries, sizeof(uint64_t), alive, fb) == alive &&
+            fwrite(names, sizeof(name_entry), hdr.name_count, fb) == hdr.name_count &&
+            fwrite(ids, sizeof(uint32_t), e->count, fb) == e->count &&
+            (hdr.arena_len == 0 || fwrite(pool->arena, 1, hdr.arena_len, fb) == hdr.arena_len) &&
+            fflush(fb) == 0 && fsync(fileno(fb)) == 0)
+            rc = 0;
+        if (fclose(fb) != 0) rc = -1;
+
+        if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+        if (rc != 0) remove(tmp);
+    }
+
+    free(tmp);
+    free(start);
+    free(entries);
+    free(names);
+    free(ids);
+    return rc;
+}
+
+/* Header fields that can be checked before the records are read */
+int indexfile_matches(const char *path, const file_header *hdr)
+{
+    if (!path || !hdr) return 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    indexfile_header ih;
+    int ok = pread(fd, &ih, sizeof(ih), 0) == (ssize_t)sizeof(ih) &&
+             ih.magic == INDEXFILE_MAGIC &&
+             ih.version == INDEXFILE_VERSION &&
+             ih.record_count == hdr->record_count &&
+             ih.date_start == hdr->date_start;
+    close(fd);
+    return ok;
+}
+
+/* [offset, offset + bytes) lies inside a mapping of length bytes */
+static int section_fits(uint64_t offset, uint64_t bytes, size_t length)
+{
+    return offset <= length && bytes <= length - offset;
+}
+
+/* Map and validate sidecar against the data file */
+indexmap *indexfile_map(const char *path, const file_header *hdr, uint64_t checksum)
+{
+    if (!path || !hdr) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(indexfile_header)) { close(fd); return NULL; }
+
+    size_t length = (size_t)st.st_size;
+    void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    const indexfile_header *ih = base;
+    uint64_t buckets = ih->bucket_count;
+    int ok = ih->magic == INDEXFILE_MAGIC &&
+             ih->version == INDEXFILE_VERSION &&
+             ih->record_count == hdr->record_count &&
+             ih->date_start == hdr->date_start &&
+             ih->checksum == checksum &&
+             buckets > 0 && buckets <= UINT32_MAX &&
+             ih->bucket_offset % sizeof(uint64_t) == 0 &&
+             ih->entry_offset % sizeof(uint64_t) == 0 &&
+             ih->bucket_offset >= sizeof(indexfile_header) &&
+             ih->bucket_offset + (buckets + 1) * sizeof(uint64_t) <= length &&
+             ih->entry_offset + ih->entry_count * sizeof(uint64_t) <= length &&
+             ((const uint64_t *)((const char *)base + ih->bucket_offset))[buckets] == ih->entry_count &&
+             ih->name_count >= 1 && ih->name_count <= UINT32_MAX && ih->arena_len <= UINT32_MAX &&
+             ih->name_offset % sizeof(uint32_t) == 0 &&
+             ih->name_id_offset % sizeof(uint32_t) == 0 &&
+             section_fits(ih->name_offset, ih->name_count * sizeof(name_entry), length) &&
+             section_fits(ih->name_id_offset, ih->record_count * sizeof(uint32_t), length) &&
+             section_fits(ih->arena_offset, ih->arena_len, length);
+
+    if (ok)
+    {
+        const char *p = base;
+        sidecar_section body[SIDECAR_SECTIONS] = {
+            { p + ih->bucket_offset, (buckets + 1) * sizeof(uint64_t) },
+            { p + ih->entry_offset, ih->entry_count * sizeof(uint64_t) },
+            { p + ih->name_offset, ih->name_count * sizeof(name_entry) },
+            { p + ih->name_id_offset, ih->record_count * sizeof(uint32_t) },
+            { p + ih->arena_offset, ih->arena_len },
+        };
+        ok = body_checksum(body) == ih->body_checksum;
+    }
+
+    indexmap *m = ok ? malloc(sizeof(indexmap)) : NULL;
+    if (!m) { munmap(base, length); return NULL; }
+
+    m->base = base;
+    m->length = length;
+    m->hdr = ih;
+    m->bucket_start = (const uint64_t *)((const char *)base + ih->bucket_offset);
+    m->entries = (uint64_t *)((char *)base + ih->entry_offset);
+    m->names = (const name_entry *)((const char *)base + ih->name_offset);
+    m->name_ids = (const uint32_t *)((const char *)base + ih->name_id_offset);
+    m->arena = (const char *)base + ih->arena_offset;
+    return m;
+}
+
+/* Adopt the saved pool instead of interning every record's name again */
+int indexmap_load_names(indexmap *m, namepool *names, const Processdiskrecord *disk)
+{
+    if (!m || !names || !disk) return -1;
+
+    const indexfile_header *ih = m->hdr;
+    for (uint64_t i = 0; i < ih->record_count; i++)
+    {
+        uint32_t id = m->name_ids[i];
+        if ((id == NAME_NONE) != !disk[i].alive) return -1;
+        if (id != NAME_NONE && (id >= ih->name_count || m->names[id].refcount == 0)) return -1;
+    }
+    return namepool_restore(names, m->names, (uint32_t)ih->name_count, m->arena, (uint32_t)ih->arena_len);
+}
+
+/* Find slot of the newest live entry for name_id, or -1 */
+static int64_t indexmap_slot(indexmap *m, engine *e, uint32_t name_id)
+{
+    uint64_t b = name_hash_of(e->names, name_id) % m->hdr->bucket_count;
+    uint64_t end = m->bucket_start[b + 1];
+
+    for (uint64_t j = m->bucket_start[b]; j < end && j < m->hdr->entry_count; j++)
+    {
+        uint64_t idx = m->entries[j];
+        if (idx == INDEXFILE_TOMBSTONE || idx >= e->count) continue;
+        if (e->process[idx].name_id == name_id) return (int64_t)j;
+    }
+    return -1;
+}
+
+int indexmap_find(indexmap *m, engine *e, uint32_t name_id, uint64_t *out_index)
+{
+    if (!m || !e || name_id == NAME_NONE || !out_index) return -1;
+
+    int64_t j = indexmap_slot(m, e, name_id);
+    if (j < 0) return -1;
+    *out_index = m->entries[j];
+    return 0;
+}
+
+/* Tombstone the entry; the private mapping keeps the file untouched */
+int indexmap_remove(indexmap *m, engine *e, uint32_t name_id, uint64_t *out_index)
+{
+    if (!m || !e || name_id == NAME_NONE) return -1;
+
+    int64_t j = indexmap_slot(m, e, name_id);
+    if (j < 0) return -1;
+    if (out_index) *out_index = m->entries[j];
+    m->entries[j] = INDEXFILE_TOMBSTONE;
+    return 0;
+}
+
+void indexmap_close(indexmap *m)
+{
+    if (!m) return;
+    munmap(m->base, m->length);
+    free(m);
+}
+
+/* Sidecar for the saved state; off the async completion path on purpose */
+int engine_save_index(engine *e)
+{
+    if (!e || !e->index_path) return -1;
+
+    async_drain(e->aio);
+    if (e->dirty) return -1;
+    return indexfile_write(e->index_path, e);
+}
+
+/* Remember sidecar path for saves and map it if it matches */
+int engine_attach_index(engine *e, const char *path, uint64_t checksum)
+{
+    if (!e || !path) return -1;
+
+    indexmap_close(e->index_map);
+    e->index_map = NULL;
+    free(e->index_path);
+    e->index_path = indexfile_path(path);
+    if (!e->index_path) return -1;
+
+    e->index_map = indexfile_map(e->index_path, &e->hdr, checksum);
+    return e->index_map ? 0 : -1;
+}
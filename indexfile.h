@@ -0,0 +1,101 @@
+/*
+* indexfile.h
+ *
+ * Persisted hash index (sidecar "<db>.idx" file).
+ * Responsibilities:
+ * - Serialize the name index and the name pool on save in a
+ *   position-independent layout.
+ * - mmap it on load and serve lookups from it directly.
+ * - Hand the saved name pool to the loader so names are not re-interned.
+ * Notes:
+ * - The sidecar is only used if it matches the data file's record count,
+ *   creation date and record checksum, and its own body checksum;
+ *   otherwise the index is rebuilt.
+ *
+ * Layout (offsets from start of file, native byte order):
+ *   indexfile_header
+ *   uint64_t bucket_start[bucket_count + 1]  // CSR offsets into entries
+ *   uint64_t entries[entry_count]            // record indexes, newest first per bucket
+ *   name_entry names[name_count]             // Pool table by id; refcount = saved records using it
+ *   uint32_t name_ids[record_count]          // Name id of each record, NAME_NONE if deleted
+ *   char arena[arena_len]                    // Name text at names[id].offset
+ */
+
+#ifndef INDEXFILE_H
+#define INDEXFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+#define INDEXFILE_MAGIC 0x58444950 // "PIDX"
+#define INDEXFILE_VERSION 3
+#define INDEXFILE_TOMBSTONE UINT64_MAX
+
+typedef struct indexfile_header {
+    uint32_t magic;          // Magic number to validate file
+    uint32_t version;        // File version
+    uint64_t bucket_count;   // Buckets used by hash_index()
+    uint64_t entry_count;    // Alive records in the index
+    uint64_t bucket_offset;  // Byte offset of bucket_start[]
+    uint64_t entry_offset;   // Byte offset of entries[]
+    uint64_t record_count;   // Data file record_count at save
+    uint64_t date_start;     // Data file date_start at save
+    uint64_t checksum;       // records_checksum() of the data file
+    uint64_t name_count;     // Pool ids, including NAME_NONE and freed ids
+    uint64_t name_offset;    // Byte offset of names[]
+    uint64_t name_id_offset; // Byte offset of name_ids[]
+    uint64_t arena_len;      // Bytes of name text
+    uint64_t arena_offset;   // Byte offset of arena[]
+    uint64_t body_checksum;  // Hash of the sections above, in layout order
+} indexfile_header;
+
+typedef struct indexmap {
+    void *base;
+    size_t length;
+    const indexfile_header *hdr;
+    const uint64_t *bucket_start;
+    uint64_t *entries;       // Private mapping: removals write tombstones
+    const name_entry *names;
+    const uint32_t *name_ids;
+    const char *arena;
+} indexmap;
+
+/* Checksum of file records [first, last). Partial sums over ranges add up to the whole. */
+uint64_t records_checksum(const Processdiskrecord *rec, uint64_t first, uint64_t last);
+
+/* Sidecar path for a database path. Caller frees. */
+char *indexfile_path(const char *db_path);
+
+/* Write the index of alive records in e->process to path. */
+int indexfile_write(const char *path, engine *e);
+
+/* Cheap pre-check that path was written for hdr's record count and date.
+ * indexfile_map() still verifies the checksum. */
+int indexfile_matches(const char *path, const file_header *hdr);
+
+/* Map path if it matches hdr and checksum and its body is intact, else NULL. */
+indexmap *indexfile_map(const char *path, const file_header *hdr, uint64_t checksum);
+
+/* Fill the empty pool names from the sidecar; record i then has name id
+ * m->name_ids[i]. disk is the file image of the records. Returns -1 if the
+ * saved names are unusable, e.g. an alive record without a name. */
+int indexmap_load_names(indexmap *m, namepool *names, const Processdiskrecord *disk);
+
+/* Lookup / logical removal in a mapped index. */
+int indexmap_find(indexmap *m, engine *e, uint32_t name_id, uint64_t *out_index);
+int indexmap_remove(indexmap *m, engine *e, uint32_t name_id, uint64_t *out_index);
+
+/* Unmap and free. */
+void indexmap_close(indexmap *m);
+
+/* Blocking: wait for async saves, then rewrite the sidecar of e's file.
+ * engine_save() does this itself; engine_save_async() never does, so an
+ * outdated sidecar is rejected by its checksum until this is called.
+ * Returns -1 if e has unsaved changes. */
+int engine_save_index(engine *e);
+
+/* Attach the sidecar of path to e if valid. Returns 0 if attached. */
+int engine_attach_index(engine *e, const char *path, uint64_t checksum);
+
+#endif
@@ -1,5 +1,7 @@
 #include "indexhash.h"
 #include "engine.h"
+#include "indexfile.h"
+#include "namepool.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -7,13 +9,10 @@
 /* Compute bucket index */
 unsigned int hash_index(const char *name, size_t bucket_count)
 {
-    unsigned int h = 0;
-    while (*name)
-        h = h * 31 + (unsigned char)*name++;
-    return h % bucket_count;
+    return name_hash(name) % bucket_count;
 }
 
-/* Allocate empty table */
+/* Allocate empty table; one bucket and one node per record slot */
 indextable *hash_create(uint32_t bucket_count)
 {
     indextable *table = calloc(1, sizeof(indextable));
@@ -21,29 +20,55 @@ indextable *hash_create(uint32_t bucket_count)
 
     table->bucket_count = bucket_count;
     table->bucket = calloc(bucket_count, sizeof(indexnode*));
-    if (!table->bucket) { free(table); return NULL; }
+    table->nodes = calloc(bucket_count, sizeof(indexnode));
+    if (!table->bucket || !table->nodes) { free(table->bucket); free(table->nodes); free(table); return NULL; }
 
     return table;
 }
 
-/* Insert process into hash */
-int insert_index(const char *name, engine *e, uint64_t record_index)
+/* Node of record_index, NULL if the table has no slot for it */
+indexnode *hash_node(indextable *table, uint64_t record_index)
 {
-    if (!e || !name) return -1;
-
-    uint64_t idx = hash_index(name, e->index->bucket_count);
+    if (record_index >= table->bucket_count) return NULL;
 
-    indexnode *new_node = malloc(sizeof(indexnode));
-    if (!new_node) return -1;
+    indexnode *node = &table->nodes[record_index];
+    node->record_count = (uint32_t)record_index;
+    return node;
+}
 
-    strncpy(new_node->name, name, sizeof(new_node->name) - 1);
-    new_node->name[sizeof(new_node->name) - 1] = '\0';
-    new_node->record_count = record_index;
+/* Link a node at the head of the bucket of hash */
+void hash_link_node(indextable *table, indexnode *node, uint32_t hash)
+{
+    uint64_t idx = hash % table->bucket_count;
 
     /* Insert at head for O(1) insertion */
-    new_node->next = e->index->bucket[idx];
-    e->index->bucket[idx] = new_node;
+    node->next = table->bucket[idx];
+    table->bucket[idx] = node;
+}
+
+/* Unlink node from the bucket of its name */
+static void unlink_node(engine *e, indexnode *node)
+{
+    indexnode **link = &e->index->bucket[name_hash_of(e->names, node->name_id) % e->index->bucket_count];
+    while (*link && *link != node)
+        link = &(*link)->next;
+    if (*link) *link = node->next;
+
+    node->name_id = NAME_NONE;
+    node->next = NULL;
+}
+
+/* Insert process into hash */
+int insert_index(uint32_t name_id, engine *e, uint64_t record_index)
+{
+    if (!e || !e->index || name_id == NAME_NONE) return -1;
+
+    indexnode *new_node = hash_node(e->index, record_index);
+    if (!new_node) return -1;
+    if (new_node->name_id != NAME_NONE) unlink_node(e, new_node); // Record re-indexed
 
+    new_node->name_id = name_id;
+    hash_link_node(e->index, new_node, name_hash_of(e->names, name_id));
     return 0;
 }
 
@@ -52,18 +77,21 @@ int find_index(const char *name, engine *e, uint64_t *out_index)
 {
     if (!e || !e->index || !out_index || !name) return -1;
 
-    uint64_t idx = hash_index(name, e->index->bucket_count);
+    uint32_t id = name_find(e->names, name);
+    if (id == NAME_NONE) return -1;
+
+    uint64_t idx = name_hash_of(e->names, id) % e->index->bucket_count;
     indexnode *n = e->index->bucket[idx];
 
     while(n)
     {
-        if(strcmp(name, n->name) == 0) {
+        if(n->name_id == id) {
             *out_index = n->record_count;
             return 0;
         }
         n = n->next;
     }
-    return -1;
+    return indexmap_find(e->index_map, e, id, out_index);
 }
 
 /* Remove process from hash */
@@ -71,13 +99,16 @@ int remove_index(const char *name, engine *e, uint64_t *out_index)
 {
     if(!e || !e->index || !name) return -1;
 
-    uint64_t h = hash_index(name, e->index->bucket_count);
+    uint32_t id = name_find(e->names, name);
+    if (id == NAME_NONE) return -1;
+
+    uint64_t h = name_hash_of(e->names, id) % e->index->bucket_count;
     indexnode *n = e->index->bucket[h];
     indexnode *prev = NULL;
 
     while(n)
     {
-        if(strcmp(name, n->name) == 0)
+        if(n->name_id == id)
         {
             if(prev)
                 prev->next = n->next;
@@ -87,13 +118,26 @@ int remove_index(const char *name, engine *e, uint64_t *out_index)
             if(out_index)
                 *out_index = n->record_count;
 
-            free(n);
+            n->name_id = NAME_NONE;
+            n->next = NULL;
             return 0;
         }
         prev = n;
         n = n->next;
     }
-    return -1;
+    return indexmap_remove(e->index_map, e, id, out_index);
+}
+
+/* Remove the node of one record, whatever other records share its name */
+int remove_index_record(engine *e, uint64_t record_index)
+{
+    if (!e || !e->index || record_index >= e->index->bucket_count) return -1;
+
+    indexnode *n = &e->index->nodes[record_index];
+    if (n->name_id == NAME_NONE) return -1;
+
+    unlink_node(e, n);
+    return 0;
 }
 
 /* Free all hash memory */
@@ -101,17 +145,7 @@ int destroy_index(engine *e)
 {
     if (!e || !e->index) return -1;
 
-    for(size_t i = 0; i < e->index->bucket_count; i++)
-    {
-        indexnode *n = e->index->bucket[i];
-        while(n)
-        {
-            indexnode *next = n->next;
-            free(n);
-            n = next;
-        }
-    }
-
+    free(e->index->nodes);
     free(e->index->bucket);
     free(e->index);
     e->index = NULL;
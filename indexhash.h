@@ -11,21 +11,25 @@
 #include <stdint.h>
 
 typedef struct indexnode {
-    char name[64];
-    uint64_t record_count;
+    uint32_t name_id;       // Interned name (namepool.h), NAME_NONE while unlinked
+    uint32_t record_count;  // Record index, below MAX_RECORDS
     struct indexnode *next;
 } indexnode;
 
 typedef struct indextable {
     uint32_t bucket_count;
     indexnode **bucket;
+    indexnode *nodes;       // Node of record i is nodes[i]; bucket_count of them
 } indextable;
 
 unsigned int hash_index(const char *name, size_t bucket_count);
 indextable *hash_create(uint32_t bucket_count);
-int insert_index(const char *name, engine *e, uint64_t record_index);
+indexnode *hash_node(indextable *table, uint64_t record_index);
+void hash_link_node(indextable *table, indexnode *node, uint32_t hash);
+int insert_index(uint32_t name_id, engine *e, uint64_t record_index);
 int find_index(const char *name, engine *e, uint64_t *out_index);
 int remove_index(const char *name, engine *e, uint64_t *out_index);
+int remove_index_record(engine *e, uint64_t record_index);
 int destroy_index(engine *e);
 
 #endif
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include "engine.h"
 #include "processrecord.h"
+#include "parallel_load.h"
 
 // Reading inputs for each function
 void read_string(char *buffer, size_t size)
@@ -30,7 +31,7 @@ int main()
         return -1;
     }
     /* Loading from the database to the engine */
-    if(engine_load(e,"process.db") != 0)
+    if(engine_load_parallel(e,"process.db", 0) != 0)
     {
         printf("Failed to load database!\n");
     }
@@ -69,7 +70,7 @@ int main()
             if(rec != NULL)
             {
                 printf("Name: %s\tPID: %lu\tCPU: %u\tRAM: %u\n",
-                       rec->name, rec->pid, rec->cpu, rec->ram);
+                       engine_name(e, rec), rec->pid, rec->cpu, rec->ram);
             }
             else
             {
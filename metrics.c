@@ -0,0 +1,358 @@
+/*
+* metrics.c
+ *
+ * Implements per-process metric history.
+ * Responsibilities:
+ * - Ring buffer and rollup maintenance.
+ * - Range queries over raw samples and rollups.
+ * - Compact save / load of all histories.
+ */
+
+#include "metrics.h"
+#include "indexhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct metric_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;      // Histories that follow
+} metric_file_header;
+
+/* Per-history record header in the file; slots follow oldest first */
+typedef struct metric_file_entry {
+    uint64_t record_index;
+    uint16_t raw_len;
+    uint16_t len[metric_levels];
+} metric_file_entry;
+
+static const uint32_t level_width[metric_levels] = { 1, 60, 3600 };
+static const uint16_t level_slots[metric_levels] = { METRIC_SEC_SLOTS, METRIC_MIN_SLOTS, METRIC_HOUR_SLOTS };
+
+static metric_rollup *level_slots_of(metric_history *h, enum metric_level level)
+{
+    switch (level) {
+        case metric_1s: return h->sec;
+        case metric_1m: return h->min;
+        default:        return h->hour;
+    }
+}
+
+static const metric_rollup *level_slots_const(const metric_history *h, enum metric_level level)
+{
+    return level_slots_of((metric_history *)h, level);
+}
+
+/* Slot holding the k-th oldest entry of a ring */
+static uint16_t ring_at(const metric_ring *r, uint16_t cap, uint16_t k)
+{
+    return (uint16_t)((r->head + cap - r->len + k) % cap);
+}
+
+/* Claim the next slot, overwriting the oldest when full */
+static uint16_t ring_push(metric_ring *r, uint16_t cap)
+{
+    uint16_t slot = r->head;
+    r->head = (uint16_t)((r->head + 1) % cap);
+    if (r->len < cap) r->len++;
+    return slot;
+}
+
+/* a + b, saturating; sets *saturated when it does */
+static uint32_t add_sat(uint32_t a, uint32_t b, int *saturated)
+{
+    if (a > UINT32_MAX - b) { *saturated = 1; return UINT32_MAX; }
+    return a + b;
+}
+
+/* Fold src into dst. Returns 1 if a counter saturated, else 0. */
+static int rollup_merge(metric_rollup *dst, const metric_rollup *src)
+{
+    if (src->count == 0) return 0;
+    if (dst->count == 0) { *dst = *src; return 0; }
+
+    int saturated = 0;
+    dst->count = add_sat(dst->count, src->count, &saturated);
+    dst->cpu_sum = add_sat(dst->cpu_sum, src->cpu_sum, &saturated);
+    dst->ram_sum = add_sat(dst->ram_sum, src->ram_sum, &saturated);
+    if (src->cpu_min < dst->cpu_min) dst->cpu_min = src->cpu_min;
+    if (src->cpu_max > dst->cpu_max) dst->cpu_max = src->cpu_max;
+    if (src->ram_min < dst->ram_min) dst->ram_min = src->ram_min;
+    if (src->ram_max > dst->ram_max) dst->ram_max = src->ram_max;
+    return saturated;
+}
+
+/* Fold one sample, already clamped to 16 bits, into its interval of a level */
+static void rollup_add(metric_history *h, enum metric_level level, uint32_t ts, uint32_t cpu, uint32_t ram)
+{
+    metric_rollup *slots = level_slots_of(h, level);
+    metric_ring *r = &h->ring[level];
+    uint16_t cap = level_slots[level];
+    uint32_t start = ts - ts % level_width[level];
+
+    metric_rollup one = {0};
+    one.ts = start;
+    one.count = 1;
+    one.cpu_sum = cpu;
+    one.ram_sum = ram;
+    one.cpu_min = one.cpu_max = (uint16_t)cpu;
+    one.ram_min = one.ram_max = (uint16_t)ram;
+
+    if (r->len == 0 || slots[ring_at(r, cap, r->len - 1)].ts < start)
+    {
+        slots[ring_push(r, cap)] = one;
+        return;
+    }
+
+    /* Late sample: walk back from the newest interval, drop it if not held */
+    for (uint16_t k = r->len; k-- > 0; )
+    {
+        metric_rollup *slot = &slots[ring_at(r, cap, k)];
+        if (slot->ts == start) { rollup_merge(slot, &one); return; }
+        if (slot->ts < start) return;
+    }
+}
+
+int metric_record(metric_history *h, uint64_t ts, uint32_t cpu, uint32_t ram)
+{
+    if (!h || ts > UINT32_MAX) return -1;
+
+    metric_sample *s = &h->raw[ring_push(&h->raw_ring, METRIC_RAW_SLOTS)];
+    s->ts = (uint32_t)ts;
+    s->cpu = cpu > UINT16_MAX ? UINT16_MAX : (uint16_t)cpu;
+    s->ram = ram > UINT16_MAX ? UINT16_MAX : (uint16_t)ram;
+
+    for (int level = 0; level < metric_levels; level++)
+        rollup_add(h, level, (uint32_t)ts, s->cpu, s->ram);
+    return 0;
+}
+
+size_t metric_samples(const metric_history *h, uint64_t from, uint64_t to, metric_sample *out, size_t max)
+{
+    if (!h || !out) return 0;
+
+    size_t n = 0;
+    for (uint16_t k = 0; k < h->raw_ring.len && n < max; k++)
+    {
+        const metric_sample *s = &h->raw[ring_at(&h->raw_ring, METRIC_RAW_SLOTS, k)];
+        if (s->ts >= from && s->ts < to) out[n++] = *s;
+    }
+    return n;
+}
+
+size_t metric_range(const metric_history *h, enum metric_level level, uint64_t from, uint64_t to,
+                    metric_rollup *out, size_t max)
+{
+    if (!h || !out || level >= metric_levels) return 0;
+
+    const metric_rollup *slots = level_slots_const(h, level);
+    const metric_ring *r = &h->ring[level];
+    size_t n = 0;
+
+    for (uint16_t k = 0; k < r->len && n < max; k++)
+    {
+        const metric_rollup *slot = &slots[ring_at(r, level_slots[level], k)];
+        if (slot->ts >= from && slot->ts < to) out[n++] = *slot;
+    }
+    return n;
+}
+
+int metric_summary(const metric_history *h, uint64_t from, uint64_t to, metric_rollup *out)
+{
+    if (!h || !out || from >= to) return -1;
+
+    /* Finest level whose oldest interval starts at or before from */
+    enum metric_level level = metric_1h;
+    for (int l = 0; l < metric_levels; l++)
+    {
+        const metric_ring *r = &h->ring[l];
+        if (r->len == 0) continue;
+        if (level_slots_const(h, l)[ring_at(r, level_slots[l], 0)].ts <= from) { level = l; break; }
+    }
+
+    const metric_rollup *slots = level_slots_const(h, level);
+    const metric_ring *r = &h->ring[level];
+    uint64_t aligned = from - from % level_width[level];
+
+    int saturated = 0;
+    memset(out, 0, sizeof(*out));
+    for (uint16_t k = 0; k < r->len; k++)
+    {
+        const metric_rollup *slot = &slots[ring_at(r, level_slots[level], k)];
+        if (slot->ts >= aligned && slot->ts < to) saturated |= rollup_merge(out, slot);
+    }
+    if (out->count == 0) return -1;
+    out->ts = (uint32_t)from;
+    return saturated;
+}
+
+metric_store *metric_store_create(size_t capacity)
+{
+    metric_store *s = calloc(1, sizeof(metric_store));
+    if (!s) return NULL;
+
+    s->history = calloc(capacity, sizeof(metric_history *));
+    if (!s->history) { free(s); return NULL; }
+    s->capacity = capacity;
+    return s;
+}
+
+void metric_store_destroy(metric_store *s)
+{
+    if (!s) return;
+    for (size_t i = 0; i < s->capacity; i++)
+        free(s->history[i]);
+    free(s->history);
+    free(s);
+}
+
+metric_history *metric_store_get(metric_store *s, uint64_t record_index, int create)
+{
+    if (!s || record_index >= s->capacity) return NULL;
+
+    metric_history *h = s->history[record_index];
+    if (h || !create) return h;
+
+    h = aligned_alloc(_Alignof(metric_history), sizeof(metric_history));
+    if (!h) return NULL;
+    memset(h, 0, sizeof(metric_history));
+
+    s->history[record_index] = h;
+    s->active++;
+    return h;
+}
+
+void metric_store_drop(metric_store *s, uint64_t record_index)
+{
+    if (!s || record_index >= s->capacity || !s->history[record_index]) return;
+
+    free(s->history[record_index]);
+    s->history[record_index] = NULL;
+    s->active--;
+}
+
+/* Write the valid slots of a ring oldest first */
+static int write_ring(FILE *fb, const void *slots, size_t size, const metric_ring *r, uint16_t cap)
+{
+    for (uint16_t k = 0; k < r->len; k++)
+        if (fwrite((const char *)slots + ring_at(r, cap, k) * size, size, 1, fb) != 1) return -1;
+    return 0;
+}
+
+int metric_store_save(metric_store *s, const char *path)
+{
+    if (!s || !path) return -1;
+
+    FILE *fb = fopen(path, "wb");
+    if (!fb) return -1;
+
+    metric_file_header hdr = { METRIC_MAGIC, METRIC_VERSION, s->active };
+    if (fwrite(&hdr, sizeof(hdr), 1, fb) != 1) goto fail;
+
+    for (size_t i = 0; i < s->capacity; i++)
+    {
+        const metric_history *h = s->history[i];
+        if (!h) continue;
+
+        metric_file_entry ent = {0};
+        ent.record_index = i;
+        ent.raw_len = h->raw_ring.len;
+        for (int l = 0; l < metric_levels; l++)
+            ent.len[l] = h->ring[l].len;
+
+        if (fwrite(&ent, sizeof(ent), 1, fb) != 1) goto fail;
+        if (write_ring(fb, h->raw, sizeof(metric_sample), &h->raw_ring, METRIC_RAW_SLOTS) != 0) goto fail;
+        for (int l = 0; l < metric_levels; l++)
+            if (write_ring(fb, level_slots_const(h, l), sizeof(metric_rollup), &h->ring[l], level_slots[l]) != 0)
+                goto fail;
+    }
+
+    if (fflush(fb) != 0) goto fail;
+    return fclose(fb) == 0 ? 0 : -1;
+
+fail:
+    fclose(fb);
+    return -1;
+}
+
+/* Read len slots into the start of a ring */
+static int read_ring(FILE *fb, void *slots, size_t size, metric_ring *r, uint16_t len, uint16_t cap)
+{
+    if (len > cap) return -1;
+    if (len && fread(slots, size, len, fb) != len) return -1;
+    r->len = len;
+    r->head = (uint16_t)(len % cap);
+    return 0;
+}
+
+int metric_store_load(metric_store *s, const char *path)
+{
+    if (!s || !path) return -1;
+
+    FILE *fb = fopen(path, "rb");
+    if (!fb) return -1;
+
+    metric_file_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fb) != 1 ||
+        hdr.magic != METRIC_MAGIC || hdr.version != METRIC_VERSION) goto fail;
+
+    for (uint64_t n = 0; n < hdr.count; n++)
+    {
+        metric_file_entry ent;
+        if (fread(&ent, sizeof(ent), 1, fb) != 1) goto fail;
+
+        metric_history *h = metric_store_get(s, ent.record_index, 1);
+        if (!h) goto fail;
+
+        if (read_ring(fb, h->raw, sizeof(metric_sample), &h->raw_ring, ent.raw_len, METRIC_RAW_SLOTS) != 0)
+            goto fail;
+        for (int l = 0; l < metric_levels; l++)
+            if (read_ring(fb, level_slots_of(h, l), sizeof(metric_rollup), &h->ring[l], ent.len[l], level_slots[l]) != 0)
+                goto fail;
+    }
+
+    fclose(fb);
+    return 0;
+
+fail:
+    fclose(fb);
+    return -1;
+}
+
+/* Start keeping history for this engine's records */
+int engine_metrics_enable(engine *e)
+{
+    if (!e) return -1;
+    if (e->metrics) return 0;
+
+    e->metrics = metric_store_create(e->capacity);
+    return e->metrics ? 0 : -1;
+}
+
+/* Update a process's current usage and record it in its history */
+int engine_sample(engine *e, const char *name, uint32_t cpu, uint32_t ram, uint64_t ts)
+{
+    if (!e || !name) return -1;
+
+    uint64_t idx;
+    if (find_index(name, e, &idx) != 0) return -1;
+
+    Processrecord *r = &e->process[idx];
+    r->cpu = cpu;
+    r->ram = ram;
+    e->dirty = 1;
+    engine_log(e, wal_update, idx);
+
+    if (!e->metrics) return 0;
+    if (ts == 0) ts = (uint64_t)time(NULL);
+    return metric_record(metric_store_get(e->metrics, idx, 1), ts, cpu, ram);
+}
+
+metric_history *engine_history(engine *e, const char *name)
+{
+    uint64_t idx;
+    if (!e || !e->metrics || find_index(name, e, &idx) != 0) return NULL;
+    return metric_store_get(e->metrics, idx, 0);
+}
@@ -0,0 +1,111 @@
+/*
+* metrics.h
+ *
+ * Per-process CPU/RAM history.
+ * Responsibilities:
+ * - Keep the most recent raw samples of a process in a ring buffer.
+ * - Roll samples up into 1s, 1m and 1h intervals (min/max/sum/count).
+ * - Answer range queries and persist histories in a compact format.
+ * Notes:
+ * - Histories are optional and allocated on first sample, one fixed-size
+ *   block per record: sizeof(metric_history) is 3648 bytes, so 100k
+ *   sampled processes use about 350 MiB.
+ * - Timestamps are Unix seconds. A late sample is merged only while its
+ *   interval is still held by the ring.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+#define METRIC_MAGIC 0x4354454d // "METC"
+#define METRIC_VERSION 1
+
+#define METRIC_RAW_SLOTS 16   // Most recent samples
+#define METRIC_SEC_SLOTS 60   // 1s rollups: last minute
+#define METRIC_MIN_SLOTS 60   // 1m rollups: last hour
+#define METRIC_HOUR_SLOTS 24  // 1h rollups: last day
+
+enum metric_level {
+    metric_1s,
+    metric_1m,
+    metric_1h,
+    metric_levels
+};
+
+typedef struct metric_sample {
+    uint32_t ts;
+    uint16_t cpu;
+    uint16_t ram;
+} metric_sample;
+
+/* One interval; averages are cpu_sum / count and ram_sum / count.
+ * Samples are clamped to 65535 and sums saturate at UINT32_MAX. */
+typedef struct metric_rollup {
+    uint32_t ts;        // Interval start
+    uint32_t cpu_sum;
+    uint32_t ram_sum;
+    uint32_t count;     // Samples in interval
+    uint16_t cpu_min;
+    uint16_t cpu_max;
+    uint16_t ram_min;
+    uint16_t ram_max;
+} metric_rollup;
+
+typedef struct metric_ring {
+    uint16_t head;      // Next slot to write
+    uint16_t len;       // Valid slots
+} metric_ring;
+
+typedef struct metric_history {
+    _Alignas(64) metric_sample raw[METRIC_RAW_SLOTS];
+    metric_rollup sec[METRIC_SEC_SLOTS];
+    metric_rollup min[METRIC_MIN_SLOTS];
+    metric_rollup hour[METRIC_HOUR_SLOTS];
+    metric_ring raw_ring;
+    metric_ring ring[metric_levels];
+} metric_history;
+
+/* Histories indexed by record index. */
+typedef struct metric_store {
+    metric_history **history;
+    size_t capacity;
+    size_t active;      // Allocated histories
+} metric_store;
+
+metric_store *metric_store_create(size_t capacity);
+void metric_store_destroy(metric_store *s);
+
+/* History of a record, allocated on demand if create is set. */
+metric_history *metric_store_get(metric_store *s, uint64_t record_index, int create);
+
+/* Free the history of a record. */
+void metric_store_drop(metric_store *s, uint64_t record_index);
+
+/* Add one sample to a history. */
+int metric_record(metric_history *h, uint64_t ts, uint32_t cpu, uint32_t ram);
+
+/* Raw samples with from <= ts < to, in arrival order. Returns number copied. */
+size_t metric_samples(const metric_history *h, uint64_t from, uint64_t to, metric_sample *out, size_t max);
+
+/* Rollups of a level starting in [from, to), oldest first. Returns number copied. */
+size_t metric_range(const metric_history *h, enum metric_level level, uint64_t from, uint64_t to,
+                    metric_rollup *out, size_t max);
+
+/* Combine [from, to) into one rollup using the finest level that still covers from.
+ * Returns 0, 1 if a sum saturated (averages are then low), -1 if nothing is held. */
+int metric_summary(const metric_history *h, uint64_t from, uint64_t to, metric_rollup *out);
+
+/* Write / read all histories. Only valid ring slots are stored. */
+int metric_store_save(metric_store *s, const char *path);
+int metric_store_load(metric_store *s, const char *path);
+
+/* Engine hooks */
+int engine_metrics_enable(engine *e);
+int engine_sample(engine *e, const char *name, uint32_t cpu, uint32_t ram, uint64_t ts);
+metric_history *engine_history(engine *e, const char *name);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+* namepool.c
+ *
+ * Implements the name interning pool.
+ */
+
+#include "namepool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NAMEPOOL_MIN_GARBAGE 4096 // Don't compact tiny arenas
+
+/* Same polynomial hash_index() has always used */
+uint32_t name_hash(const char *name)
+{
+    uint32_t h = 0;
+    for (size_t i = 0; i < PROCESS_NAME_LEN - 1 && name[i]; i++)
+        h = h * 31 + (unsigned char)name[i];
+    return h;
+}
+
+static size_t name_len(const char *name)
+{
+    return strnlen(name, PROCESS_NAME_LEN - 1);
+}
+
+namepool *namepool_create(uint32_t bucket_count)
+{
+    if (bucket_count == 0) bucket_count = 1;
+
+    namepool *p = calloc(1, sizeof(namepool));
+    if (!p) return NULL;
+
+    p->bucket_count = bucket_count;
+    p->bucket = calloc(bucket_count, sizeof(uint32_t));
+    p->count = 1; // Id 0 is NAME_NONE
+    if (!p->bucket) { free(p); return NULL; }
+    return p;
+}
+
+void namepool_destroy(namepool *p)
+{
+    if (!p) return;
+    free(p->arena);
+    free(p->entries);
+    free(p->bucket);
+    free(p);
+}
+
+static int grow_entries(namepool *p, uint32_t need)
+{
+    if (need <= p->cap) return 0;
+
+    uint32_t new_cap = p->cap ? p->cap : 64;
+    while (new_cap < need) new_cap *= 2;
+
+    name_entry *temp = realloc(p->entries, (size_t)new_cap * sizeof(name_entry));
+    if (!temp) return -1;
+    p->entries = temp;
+    p->cap = new_cap;
+    return 0;
+}
+
+static int grow_arena(namepool *p, uint32_t need)
+{
+    if (need <= p->arena_cap) return 0;
+
+    uint32_t new_cap = p->arena_cap ? p->arena_cap : 1024;
+    while (new_cap < need) new_cap *= 2;
+
+    char *temp = realloc(p->arena, new_cap);
+    if (!temp) return -1;
+    p->arena = temp;
+    p->arena_cap = new_cap;
+    return 0;
+}
+
+static int name_equal(const namepool *p, uint32_t id, const char *name, size_t len)
+{
+    const char *s = p->arena + p->entries[id].offset;
+    return strncmp(s, name, len) == 0 && s[len] == '\0';
+}
+
+static uint32_t find_hashed(const namepool *p, uint32_t hash, const char *name, size_t len)
+{
+    for (uint32_t id = p->bucket[hash % p->bucket_count]; id != NAME_NONE; id = p->entries[id].next)
+        if (p->entries[id].hash == hash && name_equal(p, id, name, len))
+            return id;
+    return NAME_NONE;
+}
+
+uint32_t name_find(const namepool *p, const char *name)
+{
+    if (!p || !name) return NAME_NONE;
+    return find_hashed(p, name_hash(name), name, name_len(name));
+}
+
+static void link_entry(namepool *p, uint32_t id, uint32_t offset, uint32_t hash)
+{
+    name_entry *ent = &p->entries[id];
+    uint32_t b = hash % p->bucket_count;
+
+    ent->offset = offset;
+    ent->refcount = 1;
+    ent->hash = hash;
+    ent->next = p->bucket[b];
+    p->bucket[b] = id;
+}
+
+uint32_t name_intern(namepool *p, const char *name)
+{
+    if (!p || !name) return NAME_NONE;
+
+    uint32_t hash = name_hash(name);
+    size_t len = name_len(name);
+    uint32_t id = find_hashed(p, hash, name, len);
+    if (id != NAME_NONE)
+    {
+        p->entries[id].refcount++;
+        return id;
+    }
+
+    if (grow_arena(p, p->arena_len + (uint32_t)len + 1) != 0) return NAME_NONE;
+
+    if (p->free_ids != NAME_NONE)
+    {
+        id = p->free_ids;
+        p->free_ids = p->entries[id].next;
+    }
+    else
+    {
+        if (grow_entries(p, p->count + 1) != 0) return NAME_NONE;
+        id = p->count++;
+    }
+
+    uint32_t offset = p->arena_len;
+    memcpy(p->arena + offset, name, len);
+    p->arena[offset + len] = '\0';
+    p->arena_len += (uint32_t)len + 1;
+
+    link_entry(p, id, offset, hash);
+    return id;
+}
+
+/* Rewrite the arena with live names only; ids do not change */
+static void compact(namepool *p)
+{
+    char *arena = malloc(p->arena_len - p->garbage ? p->arena_len - p->garbage : 1);
+    if (!arena) return; // Keep the garbage, try again on a later release
+
+    uint32_t len = 0;
+    for (uint32_t id = 1; id < p->count; id++)
+    {
+        name_entry *ent = &p->entries[id];
+        if (ent->refcount == 0) continue;
+
+        size_t n = strlen(p->arena + ent->offset) + 1;
+        memcpy(arena + len, p->arena + ent->offset, n);
+        ent->offset = len;
+        len += (uint32_t)n;
+    }
+
+    free(p->arena);
+    p->arena = arena;
+    p->arena_len = len;
+    p->arena_cap = len ? len : 1;
+    p->garbage = 0;
+}
+
+void name_release(namepool *p, uint32_t id)
+{
+    if (!p || id == NAME_NONE || id >= p->count || p->entries[id].refcount == 0) return;
+    if (--p->entries[id].refcount > 0) return;
+
+    /* Unlink from its bucket */
+    name_entry *ent = &p->entries[id];
+    uint32_t *link = &p->bucket[ent->hash % p->bucket_count];
+    while (*link != id)
+        link = &p->entries[*link].next;
+    *link = ent->next;
+
+    p->garbage += (uint32_t)strlen(p->arena + ent->offset) + 1;
+    ent->next = p->free_ids;
+    p->free_ids = id;
+
+    if (p->garbage >= NAMEPOOL_MIN_GARBAGE && p->garbage * 2 >= p->arena_len)
+        compact(p);
+}
+
+const char *name_str(const namepool *p, uint32_t id)
+{
+    if (!p || id == NAME_NONE || id >= p->count || p->entries[id].refcount == 0) return "";
+    return p->arena + p->entries[id].offset;
+}
+
+uint32_t name_hash_of(const namepool *p, uint32_t id)
+{
+    if (!p || id == NAME_NONE || id >= p->count) return 0;
+    return p->entries[id].hash;
+}
+
+int namepool_reserve(namepool *p, uint32_t names, uint32_t bytes)
+{
+    if (!p) return -1;
+    if (grow_entries(p, p->count + names) != 0) return -1;
+    return grow_arena(p, p->arena_len + bytes);
+}
+
+/*
+ * Lock-free intern for parallel loads: the caller's thread owns the
+ * bucket of hash, so only the id and arena cursors are shared; they are
+ * claimed with atomic adds inside the room made by namepool_reserve().
+ */
+uint32_t name_intern_reserved(namepool *p, uint32_t hash, const char *name)
+{
+    size_t len = name_len(name);
+    uint32_t id = find_hashed(p, hash, name, len);
+    if (id != NAME_NONE)
+    {
+        p->entries[id].refcount++;
+        return id;
+    }
+
+    id = __atomic_fetch_add(&p->count, 1, __ATOMIC_RELAXED);
+    uint32_t offset = __atomic_fetch_add(&p->arena_len, (uint32_t)len + 1, __ATOMIC_RELAXED);
+    if (id >= p->cap || offset + len + 1 > p->arena_cap) return NAME_NONE;
+
+    memcpy(p->arena + offset, name, len);
+    p->arena[offset + len] = '\0';
+    link_entry(p, id, offset, hash);
+    return id;
+}
+
+/*
+ * Sidecar load: copy the table as saved and rebuild the chains and the
+ * free list from the stored hashes, so no name is hashed or compared.
+ * Entries with refcount 0 become free ids.
+ */
+int namepool_restore(namepool *p, const name_entry *entries, uint32_t count,
+                     const char *arena, uint32_t arena_len)
+{
+    if (!p || !entries || count == 0 || p->count != 1 || p->arena_len != 0) return -1;
+    if (grow_entries(p, count) != 0 || grow_arena(p, arena_len) != 0) return -1;
+
+    memcpy(p->entries, entries, (size_t)count * sizeof(name_entry));
+    if (arena_len) memcpy(p->arena, arena, arena_len);
+
+    uint32_t live = 0;
+    for (uint32_t id = count; id-- > 1; )
+    {
+        name_entry *ent = &p->entries[id];
+        if (ent->refcount == 0)
+        {
+            ent->next = p->free_ids;
+            p->free_ids = id;
+            continue;
+        }
+
+        size_t room = ent->offset < arena_len ? arena_len - ent->offset : 0;
+        size_t len = room ? strnlen(p->arena + ent->offset, room) : 0;
+        if (len == room || len > PROCESS_NAME_LEN - 1) goto fail; // Not a name in the arena
+
+        live += (uint32_t)len + 1;
+        uint32_t b = ent->hash % p->bucket_count;
+        ent->next = p->bucket[b];
+        p->bucket[b] = id;
+    }
+
+    p->count = count;
+    p->arena_len = arena_len;
+    p->garbage = arena_len - live;
+    return 0;
+
+fail:
+    memset(p->bucket, 0, (size_t)p->bucket_count * sizeof(uint32_t));
+    p->free_ids = NAME_NONE;
+    return -1;
+}
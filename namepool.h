@@ -0,0 +1,74 @@
+/*
+* namepool.h
+ *
+ * String interning pool for process names.
+ * Responsibilities:
+ * - Store each distinct name once in an append-only arena.
+ * - Hand out compact 32-bit ids; records and index nodes hold ids.
+ * - Refcount names and reclaim them when the last record lets go.
+ * Notes:
+ * - Names are truncated to PROCESS_NAME_LEN - 1 bytes.
+ * - Pointers from name_str() are valid until the next intern or release.
+ * - Freed ids are reused; the arena is compacted once half of it is dead.
+ */
+
+#ifndef NAMEPOOL_H
+#define NAMEPOOL_H
+
+#include <stdint.h>
+#include "processrecord.h"
+
+#define NAME_NONE 0 // Id of "no name"; never allocated
+
+typedef struct name_entry {
+    uint32_t offset;    // Arena offset of the NUL-terminated name
+    uint32_t refcount;  // 0 = free id
+    uint32_t hash;      // name_hash() of the name
+    uint32_t next;      // Next id in bucket chain or free list
+} name_entry;
+
+typedef struct namepool {
+    char *arena;
+    uint32_t arena_len;
+    uint32_t arena_cap;
+    uint32_t garbage;       // Arena bytes of released names
+
+    name_entry *entries;    // Indexed by id, entries[0] unused
+    uint32_t count;         // Ids handed out so far, including freed
+    uint32_t cap;
+    uint32_t free_ids;      // Head of freed id list
+
+    uint32_t *bucket;       // Chains of ids by hash
+    uint32_t bucket_count;
+} namepool;
+
+/* Hash of a (truncated) name; hash_index() is this modulo the bucket count. */
+uint32_t name_hash(const char *name);
+
+namepool *namepool_create(uint32_t bucket_count);
+void namepool_destroy(namepool *p);
+
+/* Id of name with one more reference, adding it if new. NAME_NONE on failure. */
+uint32_t name_intern(namepool *p, const char *name);
+
+/* Id of name without taking a reference, NAME_NONE if absent. */
+uint32_t name_find(const namepool *p, const char *name);
+
+/* Drop one reference; the name is reclaimed at zero. */
+void name_release(namepool *p, uint32_t id);
+
+/* Name of id, "" for NAME_NONE. */
+const char *name_str(const namepool *p, uint32_t id);
+uint32_t name_hash_of(const namepool *p, uint32_t id);
+
+/* Parallel load: reserve room so name_intern_reserved() never reallocates. */
+int namepool_reserve(namepool *p, uint32_t names, uint32_t bytes);
+
+/* name_intern() for loaders where each thread owns a disjoint set of buckets. */
+uint32_t name_intern_reserved(namepool *p, uint32_t hash, const char *name);
+
+/* Fill an empty pool from a saved entry table and arena; ids keep their values. */
+int namepool_restore(namepool *p, const name_entry *entries, uint32_t count,
+                     const char *arena, uint32_t arena_len);
+
+#endif
@@ -0,0 +1,313 @@
+/*
+* parallel_load.c
+ *
+ * Implements multi-threaded engine load.
+ *
+ * Each worker owns a contiguous range of records and one partition of
+ * the hash buckets (shared by the index and the name pool):
+ * - Phase 1: pread() its range, checksum it and copy the fixed fields
+ *   into e->process. If the sidecar matches the summed checksum, the
+ *   saved name pool and name ids are adopted and the load is done.
+ * - Phase 2: sort the index node of each alive record into one piece per
+ *   bucket partition. Done inside phase 1, while the range is hot, when
+ *   no sidecar is expected to match.
+ * - Phase 3: once every worker has finished phase 2, intern the names of
+ *   every worker's piece for its own partition and splice the nodes into
+ *   the table (intern only if the sidecar index is mapped). Partitions
+ *   never share a bucket, so no locking is needed; the pool's id and
+ *   arena cursors are reserved up front.
+ */
+
+#include "parallel_load.h"
+#include "indexhash.h"
+#include "indexfile.h"
+#include "namepool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct load_piece {
+    indexnode *head;
+    indexnode *tail;
+} load_piece;
+
+typedef struct load_worker {
+    pthread_t thread;
+    engine *e;
+    Processdiskrecord *disk; // File image of all records
+    int fd;
+    int mapped; // Sidecar index attached without names: intern only
+    int pieces_built; // Phase 2 ran inside phase 1
+    unsigned int id;
+    unsigned int nworkers;
+    uint64_t first; // First record of this worker's range
+    uint64_t last;  // One past the last record
+    uint64_t checksum; // records_checksum() of the range
+    uint32_t names; // Alive records in the range
+    uint32_t name_bytes; // Arena bytes their names may need
+    load_piece *pieces; // One piece per partition, in record order
+    struct load_worker *all;
+    atomic_int *failed;
+} load_worker;
+
+/* Read [first, last) records with pread, retrying short reads */
+static int read_range(int fd, Processdiskrecord *out, uint64_t first, uint64_t last)
+{
+    char *buf = (char *)(out + first);
+    size_t left = (last - first) * sizeof(Processdiskrecord);
+    off_t off = sizeof(file_header) + first * sizeof(Processdiskrecord);
+
+    while (left > 0)
+    {
+        ssize_t n = pread(fd, buf, left, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        off += n;
+        left -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Phase 1 conversion and/or phase 2 index pieces, in one pass over the range */
+static int scan_range(load_worker *w, int convert, int pieces)
+{
+    engine *e = w->e;
+    uint32_t buckets = e->index->bucket_count;
+
+    for (uint64_t i = w->first; i < w->last; i++)
+    {
+        const Processdiskrecord *d = &w->disk[i];
+        if (convert) record_from_disk_id(d, NAME_NONE, &e->process[i]);
+        if (!pieces || !d->alive) continue;
+
+        indexnode *n = hash_node(e->index, i);
+        if (!n) return -1;
+        n->name_id = NAME_NONE; // Set in phase 3
+        n->next = NULL;
+        w->names++;
+        w->name_bytes += (uint32_t)strnlen(d->name, PROCESS_NAME_LEN - 1) + 1;
+
+        uint64_t part = (uint64_t)(name_hash(d->name) % buckets) * w->nworkers / buckets;
+        load_piece *p = &w->pieces[part];
+
+        /* Append keeps record order so the merge can reproduce engine_load() */
+        if (p->tail) p->tail->next = n;
+        else p->head = n;
+        p->tail = n;
+    }
+    return 0;
+}
+
+/* Phase 3: intern and splice every worker's piece for our partition */
+static int merge_partition(load_worker *w)
+{
+    engine *e = w->e;
+    int rc = 0;
+
+    for (unsigned int k = 0; k < w->nworkers; k++)
+    {
+        load_piece *p = &w->all[k].pieces[w->id];
+        indexnode *n = p->head;
+        while (n)
+        {
+            indexnode *next = n->next;
+            uint64_t i = n->record_count;
+            uint32_t hash = name_hash(w->disk[i].name);
+
+            uint32_t id = name_intern_reserved(e->names, hash, w->disk[i].name);
+            e->process[i].name_id = id;
+            if (id == NAME_NONE) rc = -1;
+
+            n->next = NULL;
+            if (!w->mapped && id != NAME_NONE)
+            {
+                n->name_id = id;
+                hash_link_node(e->index, n, hash);
+            }
+            n = next;
+        }
+        p->head = p->tail = NULL;
+    }
+    return rc;
+}
+
+/* Phase 1: read, checksum and convert the range; names come later */
+static void *read_run(void *arg)
+{
+    load_worker *w = arg;
+    if (read_range(w->fd, w->disk, w->first, w->last) != 0)
+    {
+        atomic_store(w->failed, 1);
+        return NULL;
+    }
+    w->checksum = records_checksum(w->disk, w->first, w->last);
+    if (scan_range(w, 1, w->pieces_built) != 0)
+        atomic_store(w->failed, 1);
+    return NULL;
+}
+
+static void *pieces_run(void *arg)
+{
+    load_worker *w = arg;
+    if (scan_range(w, 0, 1) != 0)
+        atomic_store(w->failed, 1);
+    return NULL;
+}
+
+static void *merge_run(void *arg)
+{
+    load_worker *w = arg;
+    if (merge_partition(w) != 0)
+        atomic_store(w->failed, 1);
+    return NULL;
+}
+
+/* Run fn on every worker; worker 0 (and any thread we fail to start) runs here */
+static void run_phase(load_worker *workers, unsigned int n, void *(*fn)(void *))
+{
+    int started[PLOAD_MAX_THREADS] = {0};
+
+    for (unsigned int i = 1; i < n; i++)
+        started[i] = pthread_create(&workers[i].thread, NULL, fn, &workers[i]) == 0;
+
+    fn(&workers[0]);
+    for (unsigned int i = 1; i < n; i++)
+    {
+        if (started[i]) pthread_join(workers[i].thread, NULL);
+        else fn(&workers[i]);
+    }
+}
+
+/* Nodes belong to the table; only the piece lists are freed */
+static void free_pieces(load_worker *workers, unsigned int n)
+{
+    for (unsigned int w = 0; w < n; w++)
+        free(workers[w].pieces);
+}
+
+/* Drop what a failed load left behind: index nodes, interned names and
+ * the mapped sidecar. The table and pool are recreated empty. */
+static void reset_engine(engine *e)
+{
+    uint32_t buckets = e->index->bucket_count;
+    uint32_t name_buckets = e->names->bucket_count;
+
+    indexmap_close(e->index_map);
+    e->index_map = NULL;
+    destroy_index(e);
+    e->index = hash_create(buckets);
+    namepool_destroy(e->names);
+    e->names = namepool_create(name_buckets);
+}
+
+static unsigned int pick_threads(unsigned int threads, uint64_t records)
+{
+    if (threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (unsigned int)cores : 1;
+    }
+    if (threads > PLOAD_MAX_THREADS) threads = PLOAD_MAX_THREADS;
+
+    uint64_t useful = records / PLOAD_MIN_RANGE;
+    if (useful < threads) threads = useful > 0 ? (unsigned int)useful : 1;
+    return threads;
+}
+
+/* Load file; use the sidecar index if it matches, else rebuild on worker threads */
+int engine_load_parallel(engine *e, const char *path, unsigned int threads)
+{
+    if (!e || !path || !e->index) return -1;
+    e->fb = file_open(path, &e->hdr);
+    if (!e->fb) return -1;
+
+    uint64_t records = e->hdr.record_count;
+    if (records == 0) { engine_attach_index(e, path, 0); return 0; }
+    if (records > e->capacity) goto fail;
+
+    /* Partitions must cover the same buckets in the index and the pool */
+    unsigned int n = pick_threads(threads, records);
+    if (e->names->bucket_count != e->index->bucket_count) n = 1;
+
+    Processdiskrecord *disk = malloc(records * sizeof(Processdiskrecord));
+    load_worker *workers = disk ? calloc(n, sizeof(load_worker)) : NULL;
+    if (!workers) { free(disk); goto fail; }
+
+    /* Without a plausible sidecar the names are needed: build pieces early */
+    char *idx_path = indexfile_path(path);
+    int pieces_early = !indexfile_matches(idx_path, &e->hdr);
+    free(idx_path);
+
+    atomic_int failed = 0;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        load_worker *w = &workers[i];
+        w->e = e;
+        w->disk = disk;
+        w->fd = fileno(e->fb);
+        w->id = i;
+        w->nworkers = n;
+        w->first = records * i / n;
+        w->last = records * (i + 1) / n;
+        w->all = workers;
+        w->failed = &failed;
+        w->pieces_built = pieces_early;
+        w->pieces = calloc(n, sizeof(load_piece));
+        if (!w->pieces) atomic_store(&failed, 1);
+    }
+
+    if (!atomic_load(&failed)) run_phase(workers, n, read_run);
+
+    int named = 0;
+    if (!atomic_load(&failed))
+    {
+        uint64_t checksum = 0;
+        for (unsigned int i = 0; i < n; i++)
+            checksum += workers[i].checksum;
+        e->count = records;
+        int mapped = engine_attach_index(e, path, checksum) == 0;
+        named = mapped && indexmap_load_names(e->index_map, e->names, disk) == 0;
+        for (unsigned int i = 0; i < n; i++)
+            workers[i].mapped = mapped;
+    }
+
+    /* Saved names: one store per record, not worth a thread */
+    if (named)
+    {
+        const uint32_t *ids = e->index_map->name_ids;
+        for (uint64_t i = 0; i < records; i++)
+            if (e->process[i].alive) e->process[i].name_id = ids[i];
+    }
+
+    if (!atomic_load(&failed) && !named)
+    {
+        if (!pieces_early) run_phase(workers, n, pieces_run);
+
+        uint32_t names = 0, bytes = 0;
+        for (unsigned int i = 0; i < n; i++)
+        {
+            names += workers[i].names;
+            bytes += workers[i].name_bytes;
+        }
+        if (!atomic_load(&failed) && namepool_reserve(e->names, names, bytes) != 0) atomic_store(&failed, 1);
+        if (!atomic_load(&failed)) run_phase(workers, n, merge_run);
+    }
+
+    int ok = !atomic_load(&failed);
+    free_pieces(workers, n);
+    free(workers);
+    free(disk);
+    if (!ok) goto fail;
+    return 0;
+
+fail:
+    e->count = 0;
+    reset_engine(e);
+    close_file(e->fb, &e->hdr);
+    e->fb = NULL;
+    return -1;
+}
@@ -0,0 +1,25 @@
+/*
+* parallel_load.h
+ *
+ * Multi-threaded database load for process engine.
+ * Responsibilities:
+ * - Read record ranges with pread() on worker threads.
+ * - Use the sidecar index and saved names when they match the data read.
+ * - Otherwise build per-partition index pieces and merge them without locks.
+ * Notes:
+ * - Result is identical to engine_load(), including bucket order; only
+ *   the name ids handed out may differ.
+ */
+
+#ifndef PARALLEL_LOAD_H
+#define PARALLEL_LOAD_H
+
+#include "engine.h"
+
+#define PLOAD_MAX_THREADS 64
+#define PLOAD_MIN_RANGE 4096 // Fewer records per worker is not worth a thread
+
+/* Load file and rebuild index on up to `threads` workers (0 = one per core). */
+int engine_load_parallel(engine *e, const char *path, unsigned int threads);
+
+#endif
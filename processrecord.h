@@ -3,7 +3,10 @@
  *
  * Defines a process record structure.
  * Responsibilities:
- * - Store process info in RAM and file.
+ * - Store process info in RAM (Processrecord) and file (Processdiskrecord).
+ * Notes:
+ * - In RAM the name is an id into the engine's name pool (namepool.h);
+ *   the file keeps the full name so the format is unchanged.
  */
 
 #ifndef PROCESSRECORD_H
@@ -11,12 +14,22 @@
 
 #include <stdint.h>
 
+#define PROCESS_NAME_LEN 64 // Including the terminating NUL
+
 typedef struct Processrecord {
-    char name[64];      // Process name
     uint64_t pid;       // Process ID
+    uint32_t name_id;   // Interned process name, NAME_NONE if deleted
     uint32_t cpu;       // CPU usage %
     uint32_t ram;       // RAM usage %
     int alive;          // Alive flag
 } Processrecord;
 
+typedef struct Processdiskrecord {
+    char name[PROCESS_NAME_LEN]; // Process name
+    uint64_t pid;       // Process ID
+    uint32_t cpu;       // CPU usage %
+    uint32_t ram;       // RAM usage %
+    int alive;          // Alive flag
+} Processdiskrecord;
+
 #endif
@@ -0,0 +1,804 @@
+/*
+* replication.c
+ *
+ * Implements WAL shipping.
+ *
+ * Primary:
+ * - engine_log() pushes committed records into a single-producer /
+ *   single-consumer ring; the engine thread never waits on a socket.
+ * - A shipper thread drains the ring into a backlog of records newer
+ *   than the last checkpoint, sends new followers a snapshot of the data
+ *   file plus that backlog, and streams batches to caught-up followers.
+ *
+ * Follower:
+ * - A receiver thread applies snapshot and batches to the replica engine
+ *   under a write lock; lookups take the read lock.
+ * - Records carry their full file image (name included), so applying one
+ *   twice is harmless; names are interned into the replica's own pool.
+ *
+ * Wire format: repl_msghdr followed by
+ * - snapshot: file_header + count Processdiskrecords (lsn = checkpoint)
+ * - batch: count repl_entry (lsn = primary LSN)
+ * - heartbeat: nothing (lsn = primary LSN)
+ */
+
+#include "replication.h"
+#include "indexhash.h"
+#include "namepool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPL_MAX_FOLLOWERS 16
+
+enum repl_msgtype {
+    repl_snapshot = 1,
+    repl_batch,
+    repl_heartbeat
+};
+
+typedef struct repl_msghdr {
+    uint32_t type;
+    uint32_t count;
+    uint64_t lsn;
+} repl_msghdr;
+
+typedef struct repl_entry {
+    uint64_t lsn;
+    uint64_t record_index;
+    uint32_t type;          // enum waltype
+    uint32_t reserved;
+    Processdiskrecord rec;  // Record image after the change
+} repl_entry;
+
+typedef struct repl_peer {
+    int fd;                 // Non-blocking
+    int streaming;          // Snapshot queued, receiving batches
+    uint64_t sent_lsn;      // Last LSN queued for the peer
+    char *out;              // Messages the socket has not taken yet
+    size_t out_len;
+    size_t out_off;         // Send cursor into out
+    size_t out_cap;
+    uint64_t progress_ms;   // Last send progress while output was pending
+} repl_peer;
+
+struct repl_primary {
+    engine *e;
+    int listen_fd;
+    int data_fd;
+    char *unix_path;        // Socket file to remove on stop
+    pthread_t thread;
+    atomic_int stop;
+
+    /* Engine thread -> shipper */
+    repl_entry *queue;
+    _Atomic uint64_t head;  // Written by the engine thread
+    _Atomic uint64_t tail;  // Written by the shipper
+    _Atomic uint64_t dropped_lsn; // Highest LSN lost to a full queue
+
+    /* Data file snapshot consistency */
+    pthread_mutex_t snap_lock;
+    _Atomic uint64_t checkpoint_lsn; // LSN the data file reflects
+
+    /* Shipper-only state */
+    repl_entry *backlog;    // Records newer than the trim point, in LSN order
+    size_t backlog_len;
+    size_t backlog_cap;
+    uint64_t primary_lsn;
+    uint64_t seen_dropped;
+    repl_peer peers[REPL_MAX_FOLLOWERS];
+    size_t npeers;
+};
+
+struct repl_follower {
+    engine *e;
+    char *addr;
+    pthread_t thread;
+    atomic_int stop;
+    pthread_rwlock_t lock;  // Guards e
+    pthread_mutex_t status_lock;
+    repl_status st;
+};
+
+/* ---------- sockets ---------- */
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(unsigned int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Open a socket for "unix:<path>" or "tcp:<host>:<port>", bound or connected */
+static int repl_socket(const char *addr, int listening)
+{
+    if (!addr) return -1;
+
+    if (strncmp(addr, "unix:", 5) == 0)
+    {
+        struct sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        if (strlen(addr + 5) >= sizeof(sa.sun_path)) return -1;
+        strcpy(sa.sun_path, addr + 5);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (listening)
+        {
+            unlink(sa.sun_path);
+            if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0 && listen(fd, REPL_MAX_FOLLOWERS) == 0)
+                return fd;
+        }
+        else if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0)
+        {
+            return fd;
+        }
+        close(fd);
+        return -1;
+    }
+
+    if (strncmp(addr, "tcp:", 4) != 0) return -1;
+
+    const char *sep = strrchr(addr + 4, ':');
+    if (!sep) return -1;
+
+    char host[256];
+    size_t host_len = (size_t)(sep - (addr + 4));
+    if (host_len >= sizeof(host)) return -1;
+    memcpy(host, addr + 4, host_len);
+    host[host_len] = '\0';
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    if (getaddrinfo(host_len ? host : NULL, sep + 1, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+
+        int one = 1;
+        if (listening)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, REPL_MAX_FOLLOWERS) == 0) break;
+        }
+        else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+/* ---------- primary ---------- */
+
+void repl_publish(repl_primary *p, uint64_t lsn, enum waltype type, uint64_t record_index,
+                  const Processdiskrecord *rec)
+{
+    if (!p || !rec) return;
+
+    uint64_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&p->tail, memory_order_acquire);
+    if (head - tail >= REPL_QUEUE_SLOTS)
+    {
+        /* Never block the writer: remember the gap instead */
+        atomic_store_explicit(&p->dropped_lsn, lsn, memory_order_release);
+        return;
+    }
+
+    repl_entry *ent = &p->queue[head & (REPL_QUEUE_SLOTS - 1)];
+    ent->lsn = lsn;
+    ent->record_index = record_index;
+    ent->type = (uint32_t)type;
+    ent->reserved = 0;
+    ent->rec = *rec;
+    atomic_store_explicit(&p->head, head + 1, memory_order_release);
+}
+
+void repl_checkpoint_begin(repl_primary *p)
+{
+    if (p) pthread_mutex_lock(&p->snap_lock);
+}
+
+void repl_checkpoint_end(repl_primary *p, int saved, uint64_t lsn)
+{
+    if (!p) return;
+    if (saved && lsn > atomic_load(&p->checkpoint_lsn))
+        atomic_store(&p->checkpoint_lsn, lsn);
+    pthread_mutex_unlock(&p->snap_lock);
+}
+
+static void peer_drop(repl_primary *p, size_t i)
+{
+    close(p->peers[i].fd);
+    free(p->peers[i].out);
+    p->peers[i] = p->peers[--p->npeers];
+}
+
+static size_t peer_pending(const repl_peer *peer)
+{
+    return peer->out_len - peer->out_off;
+}
+
+/* Room for len more bytes at the end of peer's output, NULL on failure */
+static char *peer_reserve(repl_peer *peer, size_t len)
+{
+    if (peer_pending(peer) == 0) peer->progress_ms = now_ms();
+
+    /* Reclaim sent bytes once they outweigh what is left to move */
+    if (peer->out_off > 0 && peer->out_off >= peer_pending(peer))
+    {
+        memmove(peer->out, peer->out + peer->out_off, peer_pending(peer));
+        peer->out_len -= peer->out_off;
+        peer->out_off = 0;
+    }
+
+    if (peer->out_len + len > peer->out_cap)
+    {
+        size_t new_cap = peer->out_cap ? peer->out_cap : 65536;
+        while (new_cap < peer->out_len + len) new_cap *= 2;
+        char *temp = realloc(peer->out, new_cap);
+        if (!temp) return NULL;
+        peer->out = temp;
+        peer->out_cap = new_cap;
+    }
+
+    char *dst = peer->out + peer->out_len;
+    peer->out_len += len;
+    return dst;
+}
+
+static int peer_queue(repl_peer *peer, const void *buf, size_t len)
+{
+    char *dst = peer_reserve(peer, len);
+    if (!dst) return -1;
+    memcpy(dst, buf, len);
+    return 0;
+}
+
+/* Send what the socket takes without blocking; -1 if the peer is gone */
+static int peer_flush(repl_peer *peer)
+{
+    while (peer_pending(peer) > 0)
+    {
+        ssize_t n = send(peer->fd, peer->out + peer->out_off, peer_pending(peer),
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return -1;
+        peer->out_off += (size_t)n;
+        peer->progress_ms = now_ms();
+    }
+    if (peer->out_off == peer->out_len) peer->out_off = peer->out_len = 0;
+    return 0;
+}
+
+/* Move queued records into the backlog */
+static void ship_drain(repl_primary *p)
+{
+    uint64_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+
+    for (; tail != head; tail++)
+    {
+        if (p->backlog_len == p->backlog_cap)
+        {
+            size_t new_cap = p->backlog_cap ? p->backlog_cap * 2 : 1024;
+            repl_entry *temp = realloc(p->backlog, new_cap * sizeof(repl_entry));
+            if (!temp) break; // Retry on the next round
+            p->backlog = temp;
+            p->backlog_cap = new_cap;
+        }
+        p->backlog[p->backlog_len++] = p->queue[tail & (REPL_QUEUE_SLOTS - 1)];
+        p->primary_lsn = p->backlog[p->backlog_len - 1].lsn;
+    }
+    atomic_store_explicit(&p->tail, tail, memory_order_release);
+
+    /* Streaming followers missed records: make them bootstrap again */
+    uint64_t dropped = atomic_load_explicit(&p->dropped_lsn, memory_order_acquire);
+    if (dropped != p->seen_dropped)
+    {
+        p->seen_dropped = dropped;
+        if (dropped > p->primary_lsn) p->primary_lsn = dropped;
+        for (size_t i = p->npeers; i-- > 0; )
+            if (p->peers[i].streaming) peer_drop(p, i);
+    }
+}
+
+/* First backlog index with lsn > after */
+static size_t backlog_after(repl_primary *p, uint64_t after)
+{
+    size_t lo = 0, hi = p->backlog_len;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (p->backlog[mid].lsn <= after) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Queue batches after peer->sent_lsn while the peer's output has room */
+static int ship_batches(repl_primary *p, repl_peer *peer)
+{
+    size_t i = backlog_after(p, peer->sent_lsn);
+    while (i < p->backlog_len && peer_pending(peer) < REPL_PEER_BUFFER)
+    {
+        size_t count = p->backlog_len - i;
+        if (count > REPL_BATCH_MAX) count = REPL_BATCH_MAX;
+
+        repl_msghdr hdr = { repl_batch, (uint32_t)count, p->primary_lsn };
+        if (peer_queue(peer, &hdr, sizeof(hdr)) != 0 ||
+            peer_queue(peer, &p->backlog[i], count * sizeof(repl_entry)) != 0)
+            return -1;
+
+        i += count;
+        peer->sent_lsn = p->backlog[i - 1].lsn;
+    }
+    return 0;
+}
+
+/* Queue a snapshot of the data file at the checkpoint; 1 if queued, 0 if not possible yet */
+static int ship_snapshot(repl_primary *p, repl_peer *peer)
+{
+    pthread_mutex_lock(&p->snap_lock);
+
+    uint64_t checkpoint = atomic_load(&p->checkpoint_lsn);
+    if (checkpoint < atomic_load(&p->dropped_lsn))
+    {
+        pthread_mutex_unlock(&p->snap_lock);
+        return 0; // Records after the checkpoint were lost, wait for a save
+    }
+
+    /* Read straight into the peer's output behind the message header */
+    file_header fh;
+    char *dst = NULL;
+    int ok = pread(p->data_fd, &fh, sizeof(fh), 0) == (ssize_t)sizeof(fh);
+    size_t bytes = ok ? fh.record_count * sizeof(Processdiskrecord) : 0;
+    if (ok)
+    {
+        repl_msghdr hdr = { repl_snapshot, (uint32_t)fh.record_count, checkpoint };
+        ok = peer_queue(peer, &hdr, sizeof(hdr)) == 0 &&
+             peer_queue(peer, &fh, sizeof(fh)) == 0 &&
+             (dst = peer_reserve(peer, bytes)) != NULL;
+    }
+    if (ok && bytes)
+        ok = pread(p->data_fd, dst, bytes, sizeof(file_header)) == (ssize_t)bytes;
+    pthread_mutex_unlock(&p->snap_lock);
+
+    if (!ok) return -1; // Part of a message may be queued: the peer is dropped
+    peer->sent_lsn = checkpoint;
+    peer->streaming = 1;
+    return 1;
+}
+
+/* Raise dropped_lsn to lsn; repl_publish() may store a higher one meanwhile */
+static void note_dropped(repl_primary *p, uint64_t lsn)
+{
+    uint64_t cur = atomic_load_explicit(&p->dropped_lsn, memory_order_relaxed);
+    while (cur < lsn &&
+           !atomic_compare_exchange_weak_explicit(&p->dropped_lsn, &cur, lsn,
+                                                  memory_order_release, memory_order_relaxed))
+        ;
+}
+
+/* Drop backlog records that neither a new nor a lagging follower needs,
+ * and past REPL_BACKLOG_MAX the oldest ones even if they are needed */
+static void ship_trim(repl_primary *p)
+{
+    uint64_t keep_after = atomic_load(&p->checkpoint_lsn);
+    for (size_t i = 0; i < p->npeers; i++)
+        if (p->peers[i].streaming && p->peers[i].sent_lsn < keep_after)
+            keep_after = p->peers[i].sent_lsn;
+
+    size_t cut = backlog_after(p, keep_after);
+    if (p->backlog_len - cut > REPL_BACKLOG_MAX)
+    {
+        /* Like a full queue: new followers wait for a save past the gap,
+         * followers that still needed these records bootstrap again */
+        cut = p->backlog_len - REPL_BACKLOG_MAX;
+        uint64_t lost = p->backlog[cut - 1].lsn;
+        note_dropped(p, lost);
+        if (atomic_load(&p->dropped_lsn) == lost) p->seen_dropped = lost; // Caught-up peers keep streaming
+        for (size_t i = p->npeers; i-- > 0; )
+            if (p->peers[i].streaming && p->peers[i].sent_lsn < lost) peer_drop(p, i);
+    }
+
+    if (cut == 0) return;
+    memmove(p->backlog, p->backlog + cut, (p->backlog_len - cut) * sizeof(repl_entry));
+    p->backlog_len -= cut;
+}
+
+static void *ship_run(void *arg)
+{
+    repl_primary *p = arg;
+    uint64_t last_send = now_ms();
+
+    while (!atomic_load(&p->stop))
+    {
+        struct pollfd pfd[1 + REPL_MAX_FOLLOWERS];
+        pfd[0].fd = p->listen_fd;
+        pfd[0].events = POLLIN;
+        for (size_t i = 0; i < p->npeers; i++)
+        {
+            pfd[1 + i].fd = p->peers[i].fd;
+            pfd[1 + i].events = POLLIN | (peer_pending(&p->peers[i]) ? POLLOUT : 0);
+        }
+        size_t polled = p->npeers;
+        int ready = poll(pfd, 1 + polled, REPL_POLL_MS);
+
+        /* Followers never send: readable means closed */
+        for (size_t i = polled; ready > 0 && i-- > 0; )
+        {
+            if (pfd[1 + i].revents & (POLLIN | POLLERR | POLLHUP))
+            {
+                char c;
+                ssize_t n = recv(p->peers[i].fd, &c, 1, MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    peer_drop(p, i);
+            }
+        }
+
+        if (ready > 0 && (pfd[0].revents & POLLIN))
+        {
+            int fd = accept(p->listen_fd, NULL, NULL);
+            if (fd >= 0 && p->npeers < REPL_MAX_FOLLOWERS &&
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0)
+            {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                p->peers[p->npeers++] = (repl_peer){ .fd = fd };
+            }
+            else if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+
+        ship_drain(p);
+
+        int sent = 0;
+        uint64_t now = now_ms();
+        int heartbeat = now - last_send >= REPL_HEARTBEAT_MS;
+        for (size_t i = p->npeers; i-- > 0; )
+        {
+            repl_peer *peer = &p->peers[i];
+            uint64_t before = peer->sent_lsn;
+            int rc = peer->streaming ? 0 : ship_snapshot(p, peer);
+            if (rc >= 0 && peer->streaming) rc = ship_batches(p, peer);
+            if (rc >= 0 && peer->sent_lsn != before) sent = 1;
+
+            /* Idle and caught up: tell the follower the primary LSN */
+            if (rc >= 0 && heartbeat && peer->streaming && peer_pending(peer) == 0)
+            {
+                repl_msghdr hdr = { repl_heartbeat, 0, p->primary_lsn };
+                rc = peer_queue(peer, &hdr, sizeof(hdr));
+            }
+
+            if (rc >= 0) rc = peer_flush(peer);
+
+            /* A follower that stopped reading must not pin the backlog forever */
+            if (rc >= 0 && peer_pending(peer) > 0 && now_ms() - peer->progress_ms >= REPL_PEER_TIMEOUT_MS)
+                rc = -1;
+            if (rc < 0) peer_drop(p, i);
+        }
+
+        if (sent || heartbeat) last_send = now;
+
+        ship_trim(p);
+    }
+    return NULL;
+}
+
+void repl_primary_stop(repl_primary *p)
+{
+    if (!p) return;
+
+    atomic_store(&p->stop, 1);
+    pthread_join(p->thread, NULL);
+
+    while (p->npeers > 0)
+        peer_drop(p, p->npeers - 1);
+    close(p->listen_fd);
+    if (p->unix_path) unlink(p->unix_path);
+
+    if (p->e && p->e->repl == p) p->e->repl = NULL;
+    pthread_mutex_destroy(&p->snap_lock);
+    free(p->unix_path);
+    free(p->backlog);
+    free(p->queue);
+    free(p);
+}
+
+int engine_replicate(engine *e, const char *addr)
+{
+    if (!e || !e->fb || !addr || e->repl) return -1;
+
+    /* Followers bootstrap from the file, so it must hold every change so far */
+    if (e->checkpoint_lsn < e->lsn && engine_save(e) != 0) return -1;
+
+    repl_primary *p = calloc(1, sizeof(repl_primary));
+    if (!p) return -1;
+
+    p->e = e;
+    p->data_fd = fileno(e->fb);
+    p->queue = malloc(REPL_QUEUE_SLOTS * sizeof(repl_entry));
+    p->listen_fd = repl_socket(addr, 1);
+    if (strncmp(addr, "unix:", 5) == 0) p->unix_path = strdup(addr + 5);
+    atomic_init(&p->checkpoint_lsn, e->checkpoint_lsn);
+    p->primary_lsn = e->lsn;
+    pthread_mutex_init(&p->snap_lock, NULL);
+
+    if (!p->queue || p->listen_fd < 0 || pthread_create(&p->thread, NULL, ship_run, p) != 0)
+    {
+        if (p->listen_fd >= 0) close(p->listen_fd);
+        if (p->unix_path && p->listen_fd >= 0) unlink(p->unix_path);
+        pthread_mutex_destroy(&p->snap_lock);
+        free(p->unix_path);
+        free(p->queue);
+        free(p);
+        return -1;
+    }
+
+    e->repl = p;
+    return 0;
+}
+
+/* ---------- follower ---------- */
+
+/* Make the replica's index match one record image */
+static void apply_record(engine *e, uint64_t idx, const Processdiskrecord *rec)
+{
+    if (idx >= e->capacity) return;
+
+    Processrecord *cur = &e->process[idx];
+    int was_alive = idx < e->count && cur->alive;
+    int renamed = was_alive && strncmp(name_str(e->names, cur->name_id), rec->name,
+                                       PROCESS_NAME_LEN - 1) != 0;
+
+    if (was_alive && (!rec->alive || renamed))
+    {
+        remove_index_record(e, idx);
+        name_release(e->names, cur->name_id);
+        cur->name_id = NAME_NONE;
+    }
+    if (idx >= e->count) e->count = idx + 1;
+
+    if (rec->alive && (!was_alive || renamed))
+    {
+        if (record_from_disk(e->names, rec, cur) != 0) { cur->alive = 0; return; }
+        insert_index(cur->name_id, e, idx);
+        return;
+    }
+
+    /* Same name (or still deleted): keep the interned id */
+    cur->pid = rec->pid;
+    cur->cpu = rec->cpu;
+    cur->ram = rec->ram;
+    cur->alive = rec->alive;
+}
+
+static int apply_snapshot(repl_follower *f, int fd, const repl_msghdr *hdr)
+{
+    engine *e = f->e;
+    file_header fh;
+    if (read_full(fd, &fh, sizeof(fh)) != 0 || hdr->count > e->capacity) return -1;
+
+    size_t bytes = (size_t)hdr->count * sizeof(Processdiskrecord);
+    Processdiskrecord *recs = malloc(bytes ? bytes : 1);
+    if (!recs) return -1;
+    if (bytes && read_full(fd, recs, bytes) != 0) { free(recs); return -1; }
+
+    pthread_rwlock_wrlock(&f->lock);
+    destroy_index(e);
+    e->index = hash_create((uint32_t)e->capacity);
+    namepool_destroy(e->names);
+    e->names = namepool_create((uint32_t)e->capacity);
+    if (e->count > hdr->count)
+        memset(e->process + hdr->count, 0, (e->count - hdr->count) * sizeof(Processrecord));
+    e->count = hdr->count;
+    e->hdr = fh;
+    int ok = e->index && e->names;
+    for (uint64_t i = 0; ok && i < e->count; i++)
+    {
+        ok = record_from_disk(e->names, &recs[i], &e->process[i]) == 0;
+        if (ok && e->process[i].alive)
+            insert_index(e->process[i].name_id, e, i);
+    }
+    pthread_rwlock_unlock(&f->lock);
+    free(recs);
+    if (!ok) return -1;
+
+    pthread_mutex_lock(&f->status_lock);
+    f->st.bootstrapped = 1;
+    f->st.applied_lsn = hdr->lsn;
+    if (f->st.primary_lsn < hdr->lsn) f->st.primary_lsn = hdr->lsn;
+    f->st.lag = f->st.primary_lsn - hdr->lsn;
+    pthread_mutex_unlock(&f->status_lock);
+    return 0;
+}
+
+static int apply_batch(repl_follower *f, int fd, const repl_msghdr *hdr, repl_entry *buf)
+{
+    if (hdr->count > REPL_BATCH_MAX) return -1;
+    if (read_full(fd, buf, hdr->count * sizeof(repl_entry)) != 0) return -1;
+
+    pthread_mutex_lock(&f->status_lock);
+    uint64_t applied = f->st.applied_lsn;
+    pthread_mutex_unlock(&f->status_lock);
+
+    pthread_rwlock_wrlock(&f->lock);
+    for (uint32_t i = 0; i < hdr->count; i++)
+    {
+        if (buf[i].lsn <= applied) continue;
+        apply_record(f->e, buf[i].record_index, &buf[i].rec);
+        applied = buf[i].lsn;
+    }
+    pthread_rwlock_unlock(&f->lock);
+
+    pthread_mutex_lock(&f->status_lock);
+    f->st.applied_lsn = applied;
+    f->st.primary_lsn = hdr->lsn > applied ? hdr->lsn : applied;
+    f->st.lag = f->st.primary_lsn - applied;
+    f->st.batches++;
+    pthread_mutex_unlock(&f->status_lock);
+    return 0;
+}
+
+static void follow_connection(repl_follower *f, int fd, repl_entry *buf)
+{
+    while (!atomic_load(&f->stop))
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, REPL_HEARTBEAT_MS);
+        if (ready < 0 && errno != EINTR) return;
+        if (ready <= 0) continue;
+
+        repl_msghdr hdr;
+        if (read_full(fd, &hdr, sizeof(hdr)) != 0) return;
+
+        int rc = 0;
+        switch (hdr.type) {
+            case repl_snapshot:
+                rc = apply_snapshot(f, fd, &hdr);
+                break;
+            case repl_batch:
+                rc = apply_batch(f, fd, &hdr, buf);
+                break;
+            case repl_heartbeat:
+                pthread_mutex_lock(&f->status_lock);
+                if (hdr.lsn > f->st.primary_lsn) f->st.primary_lsn = hdr.lsn;
+                f->st.lag = f->st.primary_lsn - f->st.applied_lsn;
+                pthread_mutex_unlock(&f->status_lock);
+                break;
+            default:
+                rc = -1;
+        }
+        if (rc != 0) return;
+    }
+}
+
+static void *follow_run(void *arg)
+{
+    repl_follower *f = arg;
+    repl_entry *buf = malloc(REPL_BATCH_MAX * sizeof(repl_entry));
+    if (!buf) return NULL;
+
+    while (!atomic_load(&f->stop))
+    {
+        int fd = repl_socket(f->addr, 0);
+        if (fd < 0) { sleep_ms(REPL_RETRY_MS); continue; }
+
+        pthread_mutex_lock(&f->status_lock);
+        f->st.connected = 1;
+        f->st.bootstrapped = 0;
+        f->st.applied_lsn = 0; // The next snapshot resets state anyway
+        pthread_mutex_unlock(&f->status_lock);
+
+        follow_connection(f, fd, buf);
+        close(fd);
+
+        pthread_mutex_lock(&f->status_lock);
+        f->st.connected = 0;
+        pthread_mutex_unlock(&f->status_lock);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+repl_follower *repl_follower_start(engine *replica, const char *addr)
+{
+    if (!replica || !addr) return NULL;
+
+    repl_follower *f = calloc(1, sizeof(repl_follower));
+    if (!f) return NULL;
+
+    f->e = replica;
+    f->addr = strdup(addr);
+    pthread_rwlock_init(&f->lock, NULL);
+    pthread_mutex_init(&f->status_lock, NULL);
+
+    if (!f->addr || pthread_create(&f->thread, NULL, follow_run, f) != 0)
+    {
+        pthread_rwlock_destroy(&f->lock);
+        pthread_mutex_destroy(&f->status_lock);
+        free(f->addr);
+        free(f);
+        return NULL;
+    }
+    return f;
+}
+
+int repl_follower_find(repl_follower *f, const char *name, Processrecord *out)
+{
+    if (!f || !name || !out) return -1;
+
+    pthread_rwlock_rdlock(&f->lock);
+    Processrecord *rec = engine_find(f->e, name);
+    if (rec) *out = *rec;
+    pthread_rwlock_unlock(&f->lock);
+    return rec ? 0 : -1;
+}
+
+void repl_follower_status(repl_follower *f, repl_status *out)
+{
+    if (!f || !out) return;
+
+    pthread_mutex_lock(&f->status_lock);
+    *out = f->st;
+    pthread_mutex_unlock(&f->status_lock);
+}
+
+void repl_follower_stop(repl_follower *f)
+{
+    if (!f) return;
+
+    atomic_store(&f->stop, 1);
+    pthread_join(f->thread, NULL);
+    pthread_rwlock_destroy(&f->lock);
+    pthread_mutex_destroy(&f->status_lock);
+    free(f->addr);
+    free(f);
+}
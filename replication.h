@@ -0,0 +1,76 @@
+/*
+* replication.h
+ *
+ * WAL shipping from a primary engine to read-only follower engines.
+ * Responsibilities:
+ * - Primary: publish committed WAL records to a lock-free queue and
+ *   stream them to followers from a background thread.
+ * - Follower: bootstrap from a snapshot of the primary's data file,
+ *   then apply the WAL tail in batches and serve lookups.
+ * Notes:
+ * - Addresses are "unix:<path>" or "tcp:<host>:<port>".
+ * - The primary's write path never blocks on replication: when the queue
+ *   is full records are dropped, and followers wait for the next
+ *   engine_save() to bootstrap past the gap. The shipper keeps at most
+ *   REPL_BACKLOG_MAX records; older ones are dropped the same way.
+ * - Follower sockets are non-blocking; a follower that stops reading is
+ *   dropped after REPL_PEER_TIMEOUT_MS and bootstraps again on reconnect.
+ * - A follower's engine must only be read through repl_follower_find()
+ *   while the follower is running.
+ */
+
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <stdint.h>
+#include "engine.h"
+
+#define REPL_QUEUE_SLOTS 65536   // Primary -> shipper queue, power of two
+#define REPL_BACKLOG_MAX REPL_QUEUE_SLOTS // Records kept for new and lagging followers
+#define REPL_BATCH_MAX 1024      // Records per batch message
+#define REPL_POLL_MS 1           // Shipper / follower poll interval
+#define REPL_HEARTBEAT_MS 100    // Idle heartbeat carrying the primary LSN
+#define REPL_RETRY_MS 200        // Follower reconnect delay
+#define REPL_PEER_BUFFER (1u << 20) // Unsent bytes per follower before batches wait
+#define REPL_PEER_TIMEOUT_MS 2000 // Drop a follower whose socket takes nothing this long
+
+struct repl_primary;
+typedef struct repl_primary repl_primary;
+struct repl_follower;
+typedef struct repl_follower repl_follower;
+
+typedef struct repl_status {
+    int connected;          // Connected to the primary
+    int bootstrapped;       // Snapshot applied since the last connect
+    uint64_t applied_lsn;   // Last LSN applied to the follower engine
+    uint64_t primary_lsn;   // Last LSN the primary reported
+    uint64_t lag;           // primary_lsn - applied_lsn
+    uint64_t batches;       // Batches applied
+} repl_status;
+
+/* Start shipping e's WAL to followers connecting on addr. Saves e if it has unsaved changes. */
+int engine_replicate(engine *e, const char *addr);
+
+/* Queue a committed WAL record for followers. Called by engine_log(). */
+void repl_publish(repl_primary *p, uint64_t lsn, enum waltype type, uint64_t record_index,
+                  const Processdiskrecord *rec);
+
+/* Bracket a data file write so snapshots never read it half-written. */
+void repl_checkpoint_begin(repl_primary *p);
+void repl_checkpoint_end(repl_primary *p, int saved, uint64_t lsn);
+
+/* Stop shipping and disconnect followers. */
+void repl_primary_stop(repl_primary *p);
+
+/* Follow the primary at addr into replica (an engine_create()d engine). */
+repl_follower *repl_follower_start(engine *replica, const char *addr);
+
+/* Copy the record for name into out. out->name_id refers to the replica's pool. */
+int repl_follower_find(repl_follower *f, const char *name, Processrecord *out);
+
+void repl_follower_status(repl_follower *f, repl_status *out);
+
+/* Stop following; replica stays usable as a plain engine. */
+void repl_follower_stop(repl_follower *f);
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Build and run every tests/test_*.c from the repository root:
+#   sh tests/run.sh [test_name ...]
+# CC and CFLAGS may be overridden, e.g. CFLAGS="-fsanitize=thread -g".
+set -e
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--std=gnu11 -O1 -g -fsanitize=address,undefined}
+SRC="engine.c indexhash.c indexfile.c metrics.c file_header.c wal.c \
+     async_io.c replication.c namepool.c parallel_load.c"
+
+cd "$(dirname "$0")/.."
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+if [ $# -gt 0 ]; then tests="$*"; else tests=$(cd tests && ls test_*.c | sed 's/\.c$//'); fi
+
+failed=0
+for t in $tests; do
+    $CC $CFLAGS -pthread -I. -o "$out/$t" "tests/$t.c" $SRC
+    if TEST_DIR="$out" "$out/$t"; then
+        echo "PASS $t"
+    else
+        echo "FAIL $t"
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,26 @@
+/*
+* test.h
+ *
+ * Minimal assertion helpers shared by the tests.
+ * Notes:
+ * - CHECK() reports the failing expression and keeps going; main()
+ *   returns TEST_RESULT() so run.sh sees any failure.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        test_failures++; \
+    } \
+} while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+#endif
@@ -0,0 +1,210 @@
+/*
+* test_async_io.c
+ *
+ * engine_save_async() on every backend/flag combination: io_uring and the
+ * thread pool, buffered and O_DIRECT. A reload must see exactly the
+ * records engine_save() would have written, failed writes must surface
+ * through the callback and cancel the flushes queued behind them, and the
+ * sidecar is only rewritten on request.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "engine.h"
+#include "indexfile.h"
+#include "async_io.h"
+
+#define RECORDS 3000
+
+static char db[256];
+static int calls, last_result, results[4];
+
+static void on_done(void *arg, int result)
+{
+    (void)arg;
+    if (calls < 4) results[calls] = result;
+    calls++;
+    last_result = result;
+}
+
+static void remove_db(void)
+{
+    char *idx = indexfile_path(db);
+    unlink(db);
+    unlink(idx);
+    free(idx);
+}
+
+/* Records as the file stores them */
+static Processdiskrecord *disk_image(engine *e)
+{
+    Processdiskrecord *d = calloc(e->count ? e->count : 1, sizeof(Processdiskrecord));
+    for (size_t i = 0; d && i < e->count; i++)
+        record_to_disk(e->names, &e->process[i], &d[i]);
+    return d;
+}
+
+static void run(int flags)
+{
+    remove_db();
+    engine *e = engine_create(RECORDS + 1);
+    CHECK(engine_load(e, db) == 0);
+    CHECK(engine_async_enable(e, flags) == 0);
+    if (!e->aio) { engine_destroy(e); return; }
+    printf("flags %d: %s\n", flags, async_uses_uring(e->aio) ? "io_uring" : "thread pool");
+
+    char name[64];
+    calls = 0;
+    for (int i = 0; i < RECORDS; i++)
+    {
+        snprintf(name, sizeof(name), "p%d", i);
+        engine_add(e, name);
+    }
+    CHECK(engine_save_async(e, on_done, NULL) == 0);
+
+    /* A second flush of scattered records while the first is in flight */
+    for (int i = 0; i < RECORDS; i += 3)
+    {
+        snprintf(name, sizeof(name), "p%d", i);
+        engine_delete(e, name);
+    }
+    CHECK(engine_save_async(e, on_done, NULL) == 0);
+
+    while (async_pending(e->aio) > 0)
+        engine_poll(e, 1);
+    CHECK(calls == 2 && last_result == 0);
+    CHECK(e->dirty == 0 && e->wal_size == 0);
+
+    /* Async saves leave the sidecar alone until asked */
+    char *idx = indexfile_path(db);
+    CHECK(access(idx, F_OK) != 0);
+    CHECK(engine_save_index(e) == 0);
+    CHECK(access(idx, F_OK) == 0);
+    free(idx);
+
+    Processdiskrecord *want = disk_image(e);
+    size_t count = e->count;
+    engine_destroy(e);
+
+    engine *b = engine_create(RECORDS + 1);
+    CHECK(engine_load(b, db) == 0);
+    CHECK(b->count == count);
+    CHECK(b->index_map != NULL);
+    Processdiskrecord *got = disk_image(b);
+    CHECK(want && got && memcmp(want, got, count * sizeof(Processdiskrecord)) == 0);
+    CHECK(engine_find(b, "p0") == NULL && engine_find(b, "p1") == &b->process[1]);
+
+    /* A later async save makes the old sidecar stale: it must be rejected */
+    b->process[1].cpu++;
+    engine_log(b, wal_update, 1);
+    b->dirty = 1;
+    CHECK(engine_save_async(b, NULL, NULL) == 0);
+    engine_destroy(b);
+
+    engine *c = engine_create(RECORDS + 1);
+    CHECK(engine_load(c, db) == 0);
+    CHECK(c->index_map == NULL);
+    CHECK(engine_find(c, "p1") == &c->process[1]);
+    engine_destroy(c);
+
+    free(want);
+    free(got);
+}
+
+/* Writes to a read-only descriptor fail and cancel the header and fsync */
+static void run_failure(int flags)
+{
+    remove_db();
+    int fd = open(db, O_RDONLY | O_CREAT, 0600);
+    async_io *io = async_create(fd, flags);
+    CHECK(io != NULL);
+    if (!io) { close(fd); return; }
+
+    char buf[64] = "data";
+    async_write w = { 4096, buf, sizeof(buf) };
+    calls = 0;
+    CHECK(async_flush(io, &w, 1, buf, 8, on_done, NULL) == 0);
+    async_drain(io);
+    CHECK(calls == 1 && last_result < 0);
+
+    /* Flushes queued behind a failed one are cancelled, later ones run */
+    calls = 0;
+    CHECK(async_flush(io, &w, 1, buf, 8, on_done, NULL) == 0);
+    CHECK(async_flush(io, &w, 1, buf, 8, on_done, NULL) == 0);
+    CHECK(async_flush(io, NULL, 0, buf, 8, on_done, NULL) == 0);
+    async_drain(io);
+    CHECK(calls == 3 && results[0] < 0 && results[0] != -ECANCELED);
+    CHECK(results[1] == -ECANCELED && results[2] == -ECANCELED);
+
+    CHECK(async_flush(io, &w, 1, buf, 8, on_done, NULL) == 0);
+    async_drain(io);
+    CHECK(calls == 4 && results[3] != -ECANCELED);
+    async_destroy(io);
+    close(fd);
+}
+
+/* A failed async save holds the checkpoint until a later save rewrites its records */
+static void run_checkpoint_hold(int flags)
+{
+    remove_db();
+    engine *e = engine_create(RECORDS + 1);
+    CHECK(engine_load(e, db) == 0);
+
+    int fd = open(db, O_RDONLY);
+    e->aio = async_create(fd, flags);
+    CHECK(e->aio != NULL);
+    if (!e->aio) { close(fd); engine_destroy(e); return; }
+
+    char name[64];
+    for (int i = 0; i < 100; i++)
+    {
+        snprintf(name, sizeof(name), "p%d", i);
+        engine_add(e, name);
+    }
+    calls = 0;
+    CHECK(engine_save_async(e, on_done, NULL) == 0);
+    CHECK(engine_delete(e, "p5") == 0);
+    CHECK(engine_save_async(e, on_done, NULL) == 0);
+    while (async_pending(e->aio) > 0)
+        engine_poll(e, 1);
+    CHECK(calls == 2 && results[0] < 0 && results[1] == -ECANCELED);
+    CHECK(e->checkpoint_lsn == 0 && e->dirty == 1 && e->wal_synced == 0);
+
+    /* Writable again: the next save covers both flushes and moves the checkpoint */
+    async_destroy(e->aio);
+    close(fd);
+    e->aio = NULL;
+    CHECK(engine_save_async(e, on_done, NULL) == 0);
+    while (async_pending(e->aio) > 0)
+        engine_poll(e, 1);
+    CHECK(calls == 3 && results[2] == 0);
+    CHECK(e->checkpoint_lsn == e->lsn && e->failed_lsn == 0 && e->wal_size == 0);
+    engine_destroy(e);
+
+    engine *b = engine_create(RECORDS + 1);
+    CHECK(engine_load(b, db) == 0);
+    CHECK(b->count == 100 && engine_find(b, "p5") == NULL && engine_find(b, "p99") != NULL);
+    engine_destroy(b);
+}
+
+int main(void)
+{
+    const char *dir = getenv("TEST_DIR");
+    snprintf(db, sizeof(db), "%s/async.db", dir ? dir : "/tmp");
+
+    const int flags[] = { 0, ASYNC_NO_URING, ASYNC_DIRECT, ASYNC_DIRECT | ASYNC_NO_URING };
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        run(flags[i]);
+        run_failure(flags[i] & ASYNC_NO_URING);
+        run_checkpoint_hold(flags[i] & ASYNC_NO_URING);
+    }
+
+    remove_db();
+    return TEST_RESULT();
+}
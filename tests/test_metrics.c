@@ -0,0 +1,102 @@
+/*
+* test_metrics.c
+ *
+ * Rollup counts must cover whole intervals: a day at 1 sample/s and an
+ * hour at 30 samples/s are summarised without dropping samples,
+ * histories survive a save / load round trip, and sampling between saves
+ * does not grow the WAL past the last save.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "engine.h"
+#include "metrics.h"
+
+#define T0 1699999200u // Hour aligned
+
+int main(void)
+{
+    const char *dir = getenv("TEST_DIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/metrics.bin", dir ? dir : "/tmp");
+
+    metric_store *s = metric_store_create(4);
+    CHECK(sizeof(metric_history) == 3648 && sizeof(metric_history) % 64 == 0);
+
+    /* One day at 1 sample/s */
+    metric_history *day = metric_store_get(s, 0, 1);
+    for (uint32_t t = 0; t < 86400; t++)
+        CHECK(metric_record(day, T0 + t, t % 100, 50) == 0);
+
+    metric_rollup sum;
+    CHECK(metric_summary(day, T0, T0 + 86400, &sum) == 0);
+    CHECK(sum.count == 86400);
+    CHECK(sum.ram_sum == 86400u * 50);
+    CHECK(sum.cpu_min == 0 && sum.cpu_max == 99);
+
+    metric_rollup hours[METRIC_HOUR_SLOTS];
+    CHECK(metric_range(day, metric_1h, T0, T0 + 86400, hours, METRIC_HOUR_SLOTS) == 24);
+    CHECK(hours[0].count == 3600 && hours[23].count == 3600);
+
+    /* One hour at 30 samples/s */
+    metric_history *busy = metric_store_get(s, 1, 1);
+    for (uint32_t t = 0; t < 3600; t++)
+        for (int k = 0; k < 30; k++)
+            metric_record(busy, T0 + t, 10, 20);
+    CHECK(metric_range(busy, metric_1h, T0, T0 + 3600, hours, 1) == 1);
+    CHECK(hours[0].count == 108000);
+
+    /* Above 255% CPU: min and max stay consistent with the average */
+    metric_history *hot = metric_store_get(s, 3, 1);
+    CHECK(metric_record(hot, T0, 300, 1000) == 0 && metric_record(hot, T0 + 1, 310, 1000) == 0);
+    CHECK(metric_summary(hot, T0, T0 + 60, &sum) == 0);
+    CHECK(sum.cpu_min == 300 && sum.cpu_max == 310 && sum.cpu_sum / sum.count == 305);
+    CHECK(sum.ram_min == 1000 && sum.ram_max == 1000);
+
+    /* Saturated sums are flagged, not dropped */
+    metric_history *big = metric_store_get(s, 2, 1);
+    for (uint32_t t = 0; t < 86400; t++)
+        metric_record(big, T0 + t, 65535, 0);
+    CHECK(metric_summary(big, T0, T0 + 86400, &sum) == 1);
+    CHECK(sum.count == 86400 && sum.cpu_sum == UINT32_MAX);
+
+    /* Round trip */
+    CHECK(metric_store_save(s, path) == 0);
+    metric_store *r = metric_store_create(4);
+    CHECK(metric_store_load(r, path) == 0);
+    CHECK(r->active == 4);
+    metric_history *back = metric_store_get(r, 0, 0);
+    CHECK(back && metric_summary(back, T0, T0 + 86400, &sum) == 0 && sum.count == 86400);
+    back = metric_store_get(r, 1, 0);
+    CHECK(back && metric_range(back, metric_1h, T0, T0 + 3600, hours, 1) == 1 && hours[0].count == 108000);
+    back = metric_store_get(r, 3, 0);
+    CHECK(back && metric_summary(back, T0, T0 + 60, &sum) == 0 && sum.cpu_max == 310);
+
+    metric_store_destroy(r);
+    metric_store_destroy(s);
+    unlink(path);
+
+    /* Samples are WAL updates: saves must drop the ones already on disk */
+    snprintf(path, sizeof(path), "%s/metrics.db", dir ? dir : "/tmp");
+    unlink(path);
+    engine *e = engine_create(16);
+    CHECK(engine_load(e, path) == 0 && engine_metrics_enable(e) == 0);
+    CHECK(engine_add(e, "sampled") == 0);
+    for (uint32_t t = 0; t < 100000; t++)
+    {
+        CHECK(engine_sample(e, "sampled", t % 100, 50, T0 + t) == 0);
+        if (t % 10000 == 9999) CHECK(engine_save(e) == 0 && e->wal_size == 0);
+    }
+    CHECK(e->wal_capacity <= 16384);
+    CHECK(engine_sample(e, "sampled", 1, 2, T0 + 100000) == 0);
+    CHECK(engine_save_async(e, NULL, NULL) == 0);
+    CHECK(engine_sample(e, "sampled", 3, 4, T0 + 100001) == 0);
+    while (engine_poll(e, 1) > 0);
+    CHECK(e->wal_size == 1 && e->wal_synced == 0 && e->wal[0].lsn == e->lsn);
+    engine_destroy(e);
+    unlink(path);
+    return TEST_RESULT();
+}
@@ -0,0 +1,274 @@
+/*
+* test_parallel_load.c
+ *
+ * engine_load_parallel() must produce the same engine as engine_load():
+ * same records, same bucket chains in the same order, same lookups, with
+ * the index rebuilt and with the sidecar index mapped. With the sidecar,
+ * both loaders must adopt the saved name ids instead of interning again,
+ * reject saved names that disagree with the records, and rebuild if the
+ * sidecar body is damaged. A failed load leaves the engine reusable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "engine.h"
+#include "indexhash.h"
+#include "indexfile.h"
+#include "namepool.h"
+#include "parallel_load.h"
+
+#define RECORDS 30000
+#define NAMES 9000
+
+static char db[256];
+
+static void remove_sidecar(void)
+{
+    char *idx = indexfile_path(db);
+    unlink(idx);
+    free(idx);
+}
+
+static void build_db(void)
+{
+    unlink(db);
+    remove_sidecar();
+
+    engine *e = engine_create(RECORDS + 1);
+    CHECK(engine_load(e, db) == 0);
+
+    char name[64];
+    for (int i = 0; i < RECORDS; i++)
+    {
+        snprintf(name, sizeof(name), "proc-%d", i % NAMES);
+        CHECK(engine_add(e, name) == 0);
+    }
+    for (int i = 0; i < RECORDS; i += 5)
+    {
+        snprintf(name, sizeof(name), "proc-%d", i % NAMES);
+        engine_delete(e, name);
+    }
+    CHECK(engine_save(e) == 0);
+    engine_destroy(e);
+}
+
+/* Bucket chains hold the same record indexes in the same order */
+static int same_chains(engine *a, engine *b)
+{
+    if (a->index->bucket_count != b->index->bucket_count) return 0;
+    for (uint32_t k = 0; k < a->index->bucket_count; k++)
+    {
+        indexnode *x = a->index->bucket[k], *y = b->index->bucket[k];
+        for (; x && y; x = x->next, y = y->next)
+            if (x->record_count != y->record_count) return 0;
+        if (x || y) return 0;
+    }
+    return 1;
+}
+
+static void compare(engine *a, engine *b)
+{
+    CHECK(a->count == b->count);
+    for (size_t i = 0; i < a->count && i < b->count; i++)
+    {
+        CHECK(a->process[i].pid == b->process[i].pid);
+        CHECK(a->process[i].alive == b->process[i].alive);
+        CHECK(a->process[i].cpu == b->process[i].cpu);
+        CHECK(strcmp(engine_name(a, &a->process[i]), engine_name(b, &b->process[i])) == 0);
+    }
+    CHECK(same_chains(a, b));
+    CHECK((a->index_map == NULL) == (b->index_map == NULL));
+
+    char name[64];
+    for (int i = 0; i < NAMES + 10; i++)
+    {
+        snprintf(name, sizeof(name), "proc-%d", i);
+        Processrecord *x = engine_find(a, name), *y = engine_find(b, name);
+        CHECK((x == NULL) == (y == NULL));
+        if (x && y) CHECK(x - a->process == y - b->process);
+    }
+}
+
+/* Saved names come back under the same ids, holes and all */
+static void sidecar_names(void)
+{
+    char path[300];
+    snprintf(path, sizeof(path), "%s.names", db);
+    char *idx = indexfile_path(path);
+    unlink(path);
+    unlink(idx);
+
+    engine *e = engine_create(RECORDS + 1);
+    CHECK(engine_load(e, path) == 0);
+    char name[64];
+    for (int i = 0; i < 3000; i++)
+    {
+        snprintf(name, sizeof(name), "proc-%d", i % 1000);
+        CHECK(engine_add(e, name) == 0);
+    }
+    for (int i = 0; i < 1000; i += 3)
+    {
+        /* Every record of the name: its id is freed */
+        snprintf(name, sizeof(name), "proc-%d", i);
+        while (engine_delete(e, name) == 0) {}
+    }
+    CHECK(engine_add(e, "late") == 0); // Takes a freed id
+    CHECK(engine_save(e) == 0);
+
+    for (unsigned int threads = 0; threads <= 4; threads += 4)
+    {
+        engine *l = engine_create(RECORDS + 1);
+        CHECK((threads ? engine_load_parallel(l, path, threads) : engine_load(l, path)) == 0);
+        CHECK(l->index_map != NULL && l->count == e->count);
+        for (size_t i = 0; i < l->count && i < e->count; i++)
+        {
+            CHECK(l->process[i].name_id == e->process[i].name_id);
+            CHECK(strcmp(engine_name(l, &l->process[i]), engine_name(e, &e->process[i])) == 0);
+        }
+        CHECK(l->names->count == e->names->count && l->names->free_ids != NAME_NONE);
+
+        /* The adopted pool keeps working */
+        CHECK(engine_delete(l, "late") == 0 && engine_find(l, "late") == NULL);
+        CHECK(engine_add(l, "proc-0") == 0 && engine_find(l, "proc-0") != NULL);
+        CHECK(engine_find(l, "proc-1") != NULL);
+        engine_destroy(l);
+    }
+
+    /* An alive record without a saved name: the names are not adopted */
+    Processdiskrecord *disk = calloc(e->count, sizeof(Processdiskrecord));
+    for (size_t i = 0; disk && i < e->count; i++)
+        record_to_disk(e->names, &e->process[i], &disk[i]);
+    indexmap *m = disk ? indexfile_map(idx, &e->hdr, records_checksum(disk, 0, e->count)) : NULL;
+    namepool *pool = namepool_create(RECORDS + 1);
+    CHECK(m != NULL && !e->process[0].alive);
+    if (m)
+    {
+        disk[0].alive = 1;
+        CHECK(indexmap_load_names(m, pool, disk) != 0);
+        disk[0].alive = 0;
+        CHECK(indexmap_load_names(m, pool, disk) == 0);
+        indexmap_close(m);
+    }
+    namepool_destroy(pool);
+    free(disk);
+
+    /* A damaged name id fails the body checksum: the index is rebuilt */
+    FILE *f = fopen(idx, "r+b");
+    indexfile_header ih;
+    CHECK(f && fread(&ih, sizeof(ih), 1, f) == 1);
+    uint32_t bad = (uint32_t)ih.name_count + 5;
+    CHECK(fseek(f, (long)ih.name_id_offset, SEEK_SET) == 0 && fwrite(&bad, sizeof(bad), 1, f) == 1);
+    fclose(f);
+    for (unsigned int threads = 0; threads <= 4; threads += 4)
+    {
+        engine *l = engine_create(RECORDS + 1);
+        CHECK((threads ? engine_load_parallel(l, path, threads) : engine_load(l, path)) == 0);
+        CHECK(l->index_map == NULL);
+        CHECK(strcmp(engine_name(l, &l->process[1]), "proc-1") == 0);
+        CHECK(engine_find(l, "proc-1") != NULL && engine_find(l, "late") != NULL);
+        CHECK(engine_find(l, "proc-0") == NULL);
+        engine_destroy(l);
+    }
+
+    engine_destroy(e);
+    unlink(path);
+    unlink(idx);
+    free(idx);
+}
+
+/* A load that fails part way leaves the engine empty and reusable */
+static void failed_load(void)
+{
+    char path[300];
+    snprintf(path, sizeof(path), "%s.short", db);
+    char *idx = indexfile_path(path);
+    unlink(idx);
+
+    /* Header promises more records than the file holds */
+    FILE *in = fopen(db, "rb"), *out = fopen(path, "wb");
+    CHECK(in && out);
+    char buf[65536];
+    size_t n, total = 0, keep = sizeof(file_header) + (RECORDS - 1000) * sizeof(Processdiskrecord);
+    while (in && out && total < keep && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+    {
+        if (n > keep - total) n = keep - total;
+        fwrite(buf, 1, n, out);
+        total += n;
+    }
+    if (in) fclose(in);
+    if (out) fclose(out);
+
+    engine *serial = engine_create(RECORDS + 1);
+    CHECK(engine_load(serial, db) == 0);
+
+    engine *l = engine_create(RECORDS + 1);
+    CHECK(engine_load_parallel(l, path, 4) != 0);
+    CHECK(l->fb == NULL && l->count == 0 && l->index_map == NULL);
+    CHECK(l->index && l->names && l->names->count == 1);
+    CHECK(engine_load_parallel(l, db, 4) == 0);
+    compare(serial, l);
+    CHECK(l->names->count == serial->names->count);
+
+    engine_destroy(l);
+    engine_destroy(serial);
+    unlink(path);
+    free(idx);
+}
+
+static void run(int sidecar)
+{
+    if (!sidecar) remove_sidecar();
+
+    engine *serial = engine_create(RECORDS + 1);
+    CHECK(engine_load(serial, db) == 0);
+    CHECK((serial->index_map != NULL) == sidecar);
+
+    for (unsigned int threads = 1; threads <= 8; threads++)
+    {
+        if (!sidecar) remove_sidecar();
+        engine *par = engine_create(RECORDS + 1);
+        CHECK(engine_load_parallel(par, db, threads) == 0);
+        compare(serial, par);
+
+        /* Loaded engines keep working */
+        CHECK(engine_delete(par, "proc-7") == 0);
+        CHECK(engine_add(par, "proc-7") == 0);
+        CHECK(engine_find(par, "proc-7") == &par->process[par->count - 1]);
+        engine_destroy(par);
+    }
+    engine_destroy(serial);
+}
+
+int main(void)
+{
+    const char *dir = getenv("TEST_DIR");
+    snprintf(db, sizeof(db), "%s/parallel_load.db", dir ? dir : "/tmp");
+
+    build_db();
+    run(1);
+    run(0);
+    sidecar_names();
+    failed_load();
+
+    /* Too many records for the engine */
+    engine *small = engine_create(100);
+    CHECK(engine_load_parallel(small, db, 2) != 0);
+    engine_destroy(small);
+    small = engine_create(100);
+    CHECK(engine_load(small, db) != 0 && small->fb == NULL && small->count == 0);
+    engine_destroy(small);
+
+    /* Empty database */
+    unlink(db);
+    remove_sidecar();
+    engine *empty = engine_create(10);
+    CHECK(engine_load_parallel(empty, db, 4) == 0 && empty->count == 0);
+    engine_destroy(empty);
+
+    unlink(db);
+    remove_sidecar();
+    return TEST_RESULT();
+}
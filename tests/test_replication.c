@@ -0,0 +1,238 @@
+/*
+* test_replication.c
+ *
+ * WAL shipping over a unix socket: a follower started before the changes
+ * and one started after them must both converge on adds, deletes and
+ * renames, re-bootstrap after the primary's queue overflows, report zero
+ * lag once caught up, and a client that never reads must neither stall
+ * the other followers nor engine_destroy(). The backlog stays capped
+ * without cutting off followers that keep up.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "test.h"
+#include "engine.h"
+#include "indexhash.h"
+#include "namepool.h"
+#include "replication.h"
+
+#define CAPACITY 4096
+#define WAIT_MS 10000
+
+static char db[256];
+static char addr[256];
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(unsigned int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+/* Wait until f has applied everything e logged; 0 on success */
+static int wait_caught_up(repl_follower *f, engine *e)
+{
+    uint64_t start = now_ms();
+    repl_status st;
+    do
+    {
+        repl_follower_status(f, &st);
+        if (st.connected && st.bootstrapped && st.applied_lsn == e->lsn && st.lag == 0) return 0;
+        sleep_ms(2);
+    } while (now_ms() - start < WAIT_MS);
+
+    fprintf(stderr, "follower at lsn %lu (lag %lu), primary at %lu\n",
+            (unsigned long)st.applied_lsn, (unsigned long)st.lag, (unsigned long)e->lsn);
+    return -1;
+}
+
+/* Every live primary record is found on the follower with the same fields */
+static int same_records(repl_follower *f, engine *e)
+{
+    for (size_t i = 0; i < e->count; i++)
+    {
+        Processrecord *rec = &e->process[i];
+        if (!rec->alive) continue;
+
+        Processrecord out;
+        if (repl_follower_find(f, engine_name(e, rec), &out) != 0 ||
+            out.pid != rec->pid || out.cpu != rec->cpu || out.ram != rec->ram)
+            return -1;
+    }
+    return 0;
+}
+
+/* Give a live record a new name, the way a replica applies one */
+static void rename_process(engine *e, const char *from, const char *to)
+{
+    uint64_t idx;
+    CHECK(find_index(from, e, &idx) == 0);
+
+    remove_index_record(e, idx);
+    name_release(e->names, e->process[idx].name_id);
+    e->process[idx].name_id = name_intern(e->names, to);
+    CHECK(insert_index(e->process[idx].name_id, e, idx) == 0);
+    engine_log(e, wal_update, idx);
+    e->dirty = 1;
+}
+
+/* Rewrite record 0 count times; each change is one shipped WAL record */
+static void update_burst(engine *e, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        e->process[0].cpu = (uint32_t)(i % 60);
+        engine_log(e, wal_update, 0);
+    }
+    e->dirty = 1;
+}
+
+/* A follower connection that never reads */
+static int stalled_client(void)
+{
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, addr + 5);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(fd >= 0 && connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0);
+    return fd;
+}
+
+/* Read fd until the primary closes it; 0 if it did within WAIT_MS */
+static int wait_closed(int fd)
+{
+    char buf[65536];
+    uint64_t start = now_ms();
+    while (now_ms() - start < WAIT_MS)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0) return 0;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return 0;
+        if (n < 0) sleep_ms(5);
+    }
+    return -1;
+}
+
+static void add_range(engine *e, int from, int to)
+{
+    char name[64];
+    for (int i = from; i < to; i++)
+    {
+        snprintf(name, sizeof(name), "proc-%d", i);
+        CHECK(engine_add(e, name) == 0);
+    }
+}
+
+int main(void)
+{
+    const char *dir = getenv("TEST_DIR");
+    snprintf(db, sizeof(db), "%s/replication.db", dir ? dir : "/tmp");
+    snprintf(addr, sizeof(addr), "unix:%s/repl.sock", dir ? dir : "/tmp");
+    unlink(db);
+
+    engine *e = engine_create(CAPACITY);
+    CHECK(engine_load(e, db) == 0);
+    add_range(e, 0, 1000);
+    CHECK(engine_replicate(e, addr) == 0);
+
+    /* Early follower: bootstraps from the file, then streams */
+    engine *r1 = engine_create(CAPACITY);
+    repl_follower *f1 = repl_follower_start(r1, addr);
+    CHECK(f1 && wait_caught_up(f1, e) == 0);
+
+    add_range(e, 1000, 2000);
+    CHECK(engine_delete(e, "proc-5") == 0);
+    rename_process(e, "proc-7", "renamed-7");
+    CHECK(wait_caught_up(f1, e) == 0);
+
+    /* Late follower: snapshot at the last save plus the backlog */
+    engine *r2 = engine_create(CAPACITY);
+    repl_follower *f2 = repl_follower_start(r2, addr);
+    CHECK(f2 && wait_caught_up(f2, e) == 0);
+
+    repl_follower *followers[] = { f1, f2 };
+    for (int i = 0; i < 2; i++)
+    {
+        Processrecord out;
+        CHECK(same_records(followers[i], e) == 0);
+        CHECK(repl_follower_find(followers[i], "proc-5", &out) != 0);
+        CHECK(repl_follower_find(followers[i], "proc-7", &out) != 0);
+        CHECK(repl_follower_find(followers[i], "renamed-7", &out) == 0 && out.pid == 7);
+        CHECK(repl_follower_find(followers[i], "proc-1999", &out) == 0 && out.pid == 1999);
+    }
+
+    /* A client that never reads is dropped without holding up the others */
+    int stalled = stalled_client();
+    sleep_ms(50); // Let it take its snapshot
+    update_burst(e, 30000);
+    CHECK(wait_caught_up(f1, e) == 0 && wait_caught_up(f2, e) == 0);
+    sleep_ms(REPL_PEER_TIMEOUT_MS + 500);
+    CHECK(wait_closed(stalled) == 0);
+    close(stalled);
+
+    /* Overflow the queue: followers wait for a save, then bootstrap again */
+    repl_status st;
+    int overflowed = 0;
+    for (int round = 0; round < 20 && !overflowed; round++)
+    {
+        update_burst(e, 4 * REPL_QUEUE_SLOTS);
+        sleep_ms(50);
+        repl_follower_status(f1, &st);
+        overflowed = !st.bootstrapped;
+    }
+    CHECK(overflowed);
+    CHECK(engine_save(e) == 0);
+    CHECK(wait_caught_up(f1, e) == 0 && wait_caught_up(f2, e) == 0);
+    CHECK(same_records(f1, e) == 0 && same_records(f2, e) == 0);
+
+    repl_follower_status(f2, &st);
+    CHECK(st.lag == 0 && st.primary_lsn == e->lsn && st.batches > 0);
+
+    /* More unsaved records than the backlog keeps: f1 streams on, a new
+     * follower has to wait for the next save */
+    repl_follower_stop(f2);
+    for (int round = 0; round < 2 * REPL_BACKLOG_MAX / 4096; round++)
+    {
+        update_burst(e, 4096);
+        sleep_ms(10);
+    }
+    CHECK(wait_caught_up(f1, e) == 0);
+    f2 = repl_follower_start(r2, addr);
+    sleep_ms(200);
+    repl_follower_status(f2, &st);
+    CHECK(!st.bootstrapped);
+    CHECK(engine_save(e) == 0);
+    CHECK(wait_caught_up(f2, e) == 0 && same_records(f2, e) == 0);
+
+    /* Shutting down with a stalled client connected must not hang */
+    stalled = stalled_client();
+    sleep_ms(50);
+    update_burst(e, 30000);
+    CHECK(wait_caught_up(f1, e) == 0);
+    uint64_t start = now_ms();
+    engine_destroy(e);
+    CHECK(now_ms() - start < REPL_PEER_TIMEOUT_MS / 2);
+    close(stalled);
+
+    repl_follower_stop(f1);
+    repl_follower_stop(f2);
+    engine_destroy(r1);
+    engine_destroy(r2);
+    unlink(db);
+    return TEST_RESULT();
+}
@@ -10,6 +10,7 @@
 //
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "wal.h"
 
 /*
@@ -72,13 +73,42 @@ int wal_append(walenter **wal ,size_t *size ,size_t *capacity, enum waltype type
     return 0;
 }
 
+/*
+ * Drop entries already reflected in the file.
+ * Moves the remaining tail to the front, then halves the buffer if it is
+ * less than a quarter full, so a burst is given back over a few saves
+ * without reallocating on every one. A failed shrink keeps the old buffer.
+ */
+void wal_discard(walenter **wal, size_t *size, size_t *capacity, size_t n)
+{
+    if (!wal || !*wal || !size || !capacity)
+        return;
+    if (n > *size)
+        n = *size;
+
+    memmove(*wal, *wal + n, sizeof(walenter) * (*size - n));
+    *size -= n;
+
+    if (*capacity <= 8 || *size >= *capacity / 4)
+        return;
+
+    size_t new_capacity = *capacity / 2;
+
+    walenter *temp = realloc(*wal, sizeof(walenter) * new_capacity);
+    if (!temp)
+        return;
+
+    *wal = temp;
+    *capacity = new_capacity;
+}
+
 /*
  * Clear WAL logically.
  * Resets wal_size to 0. Memory is not freed.
  */
 void wal_clear(walenter **wal,size_t *wal_size)
 {
-    if (!wal || !*wal || !wal_size)
+    if (wal && *wal && wal_size)
         *wal_size = 0;
 }
 
@@ -90,5 +120,8 @@ void wal_clear(walenter **wal,size_t *wal_size)
 void wal_free(walenter **wal)
 {
     if (wal)
-        free(wal);
+    {
+        free(*wal);
+        *wal = NULL;
+    }
 }
\ No newline at end of file
@@ -24,6 +24,7 @@ enum waltype {
 typedef struct {
     enum waltype type;      // Type of operation
     uint64_t record_index;  // Index of affected record
+    uint64_t lsn;           // Log sequence number, set by engine_log()
 } walenter;
 
 /* Initialize a WAL buffer.
@@ -36,6 +37,11 @@ int wal_init(walenter **wal ,size_t *size ,size_t *capacity);
  */
 int wal_append(walenter **wal ,size_t *size ,size_t *capacity, enum waltype type, uint64_t record_index);
 
+/* Drop the first n entries, keeping the rest in order.
+ * Halves the buffer when it is mostly unused.
+ */
+void wal_discard(walenter **wal, size_t *size, size_t *capacity, size_t n);
+
 /* Reset WAL size to 0. Does not free memory. */
 void wal_clear(walenter **wal,size_t *size);
 